@@ -1,27 +1,108 @@
 #include <benchmark/benchmark.h>
 #include <omp.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "gol_field.h"
 #include "gol_vanilla.h"
 #include "gol_omp.h"
 #include "gol_mpi.h"
+#include "gol_sparse.h"
+#include "gol_inplace.h"
+#include "gol_tiled.h"
+#include "gol_lightcone.h"
+#include "gol_ensemble.h"
+#include "gol_output.h"
+#include "gol_affinity.h"
 
-static void BM_SimulateStep(benchmark::State &state, simulate_func simulateFunc)
+// Minor page faults of the process so far
+static long minorPageFaults()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+// Threads of the following parallel regions, pinned with the placement of --gol_placement
+static void setBenchmarkThreads(int threads)
+{
+    omp_set_dynamic(0);
+    omp_set_num_threads(threads);
+    applyThreadPlacement(threads);
+}
+
+// Read miss counter of cache (PERF_COUNT_HW_CACHE_DTLB, _LL, ...) for the calling thread, -1 if perf events are not
+// available
+static int openMissCounter(unsigned long long cache)
+{
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_HW_CACHE;
+    attributes.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+// Opens a read miss counter of cache for every OpenMP thread, counters[i] is -1 if perf events are not available
+static void openMissCounters(int *counters, unsigned long long cache)
+{
+    #pragma omp parallel
+    {
+        counters[omp_get_thread_num()] = openMissCounter(cache);
+    }
+}
+
+// Sum of the counters and closes them, -1 if any of them is not available
+static long long closeMissCounters(int *counters, int threads)
+{
+    long long sum = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        long long value = 0;
+        if (sum < 0 || counters[i] < 0 || read(counters[i], &value, sizeof(value)) != sizeof(value))
+            sum = -1;
+        else
+            sum += value;
+
+        if (counters[i] >= 0)
+            close(counters[i]);
+    }
+    return sum;
+}
+
+static void BM_SimulateStep(benchmark::State &state, simulate_func simulateFunc, enum BoundaryMode boundary, unsigned int tracking,
+                            enum FieldAllocation allocation)
 {
     int boardSize = state.range(0);
     int threads = state.range(1);
 
+    // Buffers of the previous configuration come from the pool and fault in no new pages
+    enum FieldAllocation previousAllocation = fieldAllocator.allocation;
+    setFieldAllocation(allocation, true);
+    long pageFaults = minorPageFaults();
+
+    // Before the fields are initialized, they are segmented for the number of threads
+    setBenchmarkThreads(threads);
+
     struct Field field1;
     struct Field field2;
 
     struct Field *currentFieldPtr = &field1;
     struct Field *newFieldPtr = &field2;
     initializeFields(currentFieldPtr, newFieldPtr, boardSize, boardSize, 0, 0);
+    setBoundaryMode(currentFieldPtr, newFieldPtr, boundary);
+    currentFieldPtr->tracking = tracking;
+    newFieldPtr->tracking = tracking;
 
     fillRandom(currentFieldPtr);
 
-    omp_set_dynamic(0);
-    omp_set_num_threads(threads);
+    int *counters = (int *)malloc(2 * threads * sizeof(int));
+    openMissCounters(counters, PERF_COUNT_HW_CACHE_DTLB);
+    openMissCounters(counters + threads, PERF_COUNT_HW_CACHE_LL);
 
     struct Field *temp;
     int timestep = 0;
@@ -42,8 +123,331 @@ static void BM_SimulateStep(benchmark::State &state, simulate_func simulateFunc)
     // Number of processed cells
     state.SetItemsProcessed(boardSize * boardSize * state.iterations());
 
-    free(field1.field);
-    free(field2.field);
+    long long tlbMisses = closeMissCounters(counters, threads);
+    long long cacheMisses = closeMissCounters(counters + threads, threads);
+    free(counters);
+    if (tlbMisses >= 0)
+        state.counters["dtlb_misses"] = benchmark::Counter(tlbMisses, benchmark::Counter::kAvgIterations);
+    if (cacheMisses >= 0)
+        state.counters["llc_misses"] = benchmark::Counter(cacheMisses, benchmark::Counter::kAvgIterations);
+    state.counters["page_faults"] = minorPageFaults() - pageFaults;
+
+    freeField(&field1);
+    freeField(&field2);
+    setFieldAllocation(previousAllocation, true);
+}
+
+// OMP engine with every n-th generation written by the output pipeline in full resolution / as density pyramid
+// (0 disables them)
+static void BM_SimulateStepOutput(benchmark::State &state)
+{
+    int boardSize = state.range(0);
+    int every = state.range(1);
+    int pyramidEvery = state.range(2);
+    int threads = state.range(3);
+
+    setBenchmarkThreads(threads);
+
+    struct Field field1;
+    struct Field field2;
+
+    struct Field *currentFieldPtr = &field1;
+    struct Field *newFieldPtr = &field2;
+    initializeFields(currentFieldPtr, newFieldPtr, boardSize, boardSize, 0, 0);
+    fillRandom(currentFieldPtr);
+
+    struct OutputPipeline output;
+    initializeOutputPipeline(&output, currentFieldPtr, "output/benchmark/", every, pyramidEvery, 3, OUTPUT_DEFAULT_DEPTH,
+                             OUTPUT_DEFAULT_THREADS);
+
+    struct Field *temp;
+    int timestep = 0;
+    // File names repeat to bound the disk usage
+    int period = MAX(every, 1) * MAX(pyramidEvery, 1) * 2 * OUTPUT_DEFAULT_DEPTH;
+    for (auto _ : state)
+    {
+        prepareOutput(&output, currentFieldPtr, newFieldPtr, (timestep + 1) % period);
+        simulateStepOMPPlain(currentFieldPtr, newFieldPtr, timestep);
+        timestep++;
+
+        temp = currentFieldPtr;
+        currentFieldPtr = newFieldPtr;
+        newFieldPtr = temp;
+
+        submitOutput(&output, currentFieldPtr, timestep % period);
+
+        benchmark::DoNotOptimize(currentFieldPtr);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed((int64_t)boardSize * boardSize * state.iterations());
+
+    finishOutputPipeline(&output);
+    state.counters["copy_time"] = benchmark::Counter(output.copyTime, benchmark::Counter::kAvgIterations);
+    state.counters["stall_time"] = benchmark::Counter(output.stallTime, benchmark::Counter::kAvgIterations);
+    state.counters["bytes_written"] = benchmark::Counter(output.bytesWritten, benchmark::Counter::kAvgIterations);
+
+    freeField(&field1);
+    freeField(&field2);
+}
+
+// In-place engine on a single field
+static void BM_SimulateStepInPlace(benchmark::State &state)
+{
+    int boardSize = state.range(0);
+    int threads = state.range(1);
+
+    setBenchmarkThreads(threads);
+
+    struct Field field;
+    initializeField(&field, boardSize, boardSize, 0, 0);
+    fillRandom(&field);
+
+    int timestep = 0;
+    for (auto _ : state)
+    {
+        simulateStepInPlace(&field, &field, timestep);
+        timestep++;
+
+        benchmark::DoNotOptimize(field.field);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed((int64_t)boardSize * boardSize * state.iterations());
+
+    freeField(&field);
+}
+
+// Window of a 4096x4096 board at generation T from its light cone, items are the cells a full run would update
+static void BM_ComputeViewport(benchmark::State &state)
+{
+    int boardSize = 1 << 12;
+    int windowSize = state.range(0);
+    int generations = state.range(1);
+    int threads = state.range(2);
+
+    setBenchmarkThreads(threads);
+
+    struct Field field;
+    initializeField(&field, boardSize, boardSize, 0, 0);
+    fillRandom(&field);
+
+    FieldType *window = (FieldType *)malloc((size_t)windowSize * windowSize * sizeof(FieldType));
+    for (auto _ : state)
+    {
+        computeViewport(&field, boardSize / 2, boardSize / 2, windowSize, windowSize, generations, window);
+
+        benchmark::DoNotOptimize(window);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed((int64_t)boardSize * boardSize * generations * state.iterations());
+    state.counters["cone_fraction"] = lightConeWork(windowSize, windowSize, generations) / ((double)boardSize * boardSize * generations);
+
+    free(window);
+    freeField(&field);
+}
+
+// Tiled Z-order layout, with the same miss counters as BM_SimulateStep
+static void BM_SimulateStepTiled(benchmark::State &state)
+{
+    int boardSize = state.range(0);
+    int threads = state.range(1);
+
+    setBenchmarkThreads(threads);
+
+    struct Field field;
+    initializeField(&field, boardSize, boardSize, 0, 0);
+    fillRandom(&field);
+
+    struct TiledField tiled[2];
+    initializeTiledField(&tiled[0], boardSize, boardSize, field.boundary);
+    initializeTiledFieldOther(&tiled[1], &tiled[0]);
+    tiledFromField(&tiled[0], &field);
+
+    int *counters = (int *)malloc(2 * threads * sizeof(int));
+    openMissCounters(counters, PERF_COUNT_HW_CACHE_DTLB);
+    openMissCounters(counters + threads, PERF_COUNT_HW_CACHE_LL);
+
+    int timestep = 0;
+    for (auto _ : state)
+    {
+        simulateStepTiled(&tiled[timestep & 1], &tiled[(timestep + 1) & 1]);
+        timestep++;
+
+        benchmark::DoNotOptimize(tiled[timestep & 1].tiles);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed((int64_t)boardSize * boardSize * state.iterations());
+
+    long long tlbMisses = closeMissCounters(counters, threads);
+    long long cacheMisses = closeMissCounters(counters + threads, threads);
+    free(counters);
+    if (tlbMisses >= 0)
+        state.counters["dtlb_misses"] = benchmark::Counter(tlbMisses, benchmark::Counter::kAvgIterations);
+    if (cacheMisses >= 0)
+        state.counters["llc_misses"] = benchmark::Counter(cacheMisses, benchmark::Counter::kAvgIterations);
+
+    freeTiledField(&tiled[0]);
+    freeTiledField(&tiled[1]);
+    freeField(&field);
+}
+
+// Sparse engine on a board with the given population density in per mille
+static void BM_SimulateStepSparse(benchmark::State &state)
+{
+    int boardSize = state.range(0);
+    double density = state.range(1) / 1000.0;
+    int threads = state.range(2);
+
+    struct Field field;
+    initializeField(&field, boardSize, boardSize, 0, 0);
+    fillRandomDensity(&field, density);
+
+    setBenchmarkThreads(threads);
+
+    struct SparseField sparse1;
+    struct SparseField sparse2;
+    initializeSparseField(&sparse1, boardSize, boardSize, field.boundary);
+    initializeSparseField(&sparse2, boardSize, boardSize, field.boundary);
+    sparseFromField(&sparse1, &field);
+
+    struct SparseField *currentSparsePtr = &sparse1;
+    struct SparseField *newSparsePtr = &sparse2;
+    struct SparseField *temp;
+    for (auto _ : state)
+    {
+        simulateStepSparse(currentSparsePtr, newSparsePtr);
+
+        temp = currentSparsePtr;
+        currentSparsePtr = newSparsePtr;
+        newSparsePtr = temp;
+
+        benchmark::DoNotOptimize(currentSparsePtr);
+        benchmark::ClobberMemory();
+    }
+    // Number of processed cells (of the whole board to be comparable with the dense engines)
+    state.SetItemsProcessed((int64_t)boardSize * boardSize * state.iterations());
+    state.counters["population"] = currentSparsePtr->population;
+
+    freeSparseField(&sparse1);
+    freeSparseField(&sparse2);
+    freeField(&field);
+}
+
+// Ensemble of many small boards, items are cells of all boards
+static void BM_SimulateEnsemble(benchmark::State &state)
+{
+    int boards = state.range(0);
+    int boardSize = state.range(1);
+    int threads = state.range(2);
+
+    setBenchmarkThreads(threads);
+
+    struct Ensemble ensemble;
+    initializeEnsemble(&ensemble, boards, boardSize, boardSize, BOUNDARY_TORUS);
+    for (int i = 0; i < boards; i++)
+    {
+        ensembleFillRandom(&ensemble, i, i, 0.1);
+    }
+
+    for (auto _ : state)
+    {
+        simulateEnsemble(&ensemble, 1);
+
+        benchmark::DoNotOptimize(ensemble.current);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed((int64_t)boards * boardSize * boardSize * state.iterations());
+
+    freeEnsemble(&ensemble);
+}
+
+//
+// Machine Peaks (Roofline)
+//
+
+// STREAM triad a = b + s * c over arrays far larger than the caches. Bytes are 4 * 8 per element: unlike STREAM the
+// write allocate of a is counted, as in the models of the engines (ROOFLINE_MODELS of benchmark.py), so both sides of
+// the roofline count the actual DRAM traffic.
+static void BM_PeakBandwidth(benchmark::State &state)
+{
+    long elements = state.range(0);
+    int threads = state.range(1);
+
+    setBenchmarkThreads(threads);
+
+    double *a = (double *)malloc(elements * sizeof(double));
+    double *b = (double *)malloc(elements * sizeof(double));
+    double *c = (double *)malloc(elements * sizeof(double));
+
+    // First touch by the threads that use the pages later
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < elements; i++)
+    {
+        a[i] = 0;
+        b[i] = 1;
+        c[i] = 2;
+    }
+
+    double scalar = 3;
+    for (auto _ : state)
+    {
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < elements; i++)
+            a[i] = b[i] + scalar * c[i];
+
+        benchmark::DoNotOptimize(a);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed((int64_t)4 * elements * sizeof(double) * state.iterations());
+
+    free(a);
+    free(b);
+    free(c);
+}
+
+#ifdef __AVX512BW__
+#define PEAK_VECTOR_BYTES 64
+#else
+#define PEAK_VECTOR_BYTES 32
+#endif
+#define PEAK_CHAINS 12 // independent accumulators, enough to hide the latency of the vector units
+
+typedef uint8_t PeakVector __attribute__((vector_size(PEAK_VECTOR_BYTES)));
+
+// Throughput of 8 bit SIMD adds (the operation of the dense kernels) on register resident data, items are byte
+// operations
+static void BM_PeakCompute(benchmark::State &state)
+{
+    int threads = state.range(0);
+    long iterations = 1 << 20;
+
+    setBenchmarkThreads(threads);
+
+    for (auto _ : state)
+    {
+        #pragma omp parallel
+        {
+            PeakVector accumulators[PEAK_CHAINS];
+            PeakVector increment;
+            for (int k = 0; k < PEAK_VECTOR_BYTES; k++)
+                increment[k] = omp_get_thread_num() + k;
+            for (int chain = 0; chain < PEAK_CHAINS; chain++)
+                accumulators[chain] = increment + (uint8_t)chain;
+
+            for (long i = 0; i < iterations; i++)
+            {
+                for (int chain = 0; chain < PEAK_CHAINS; chain++)
+                    accumulators[chain] += increment;
+
+                // Keeps the compiler from folding the loop into a multiplication, unlike DoNotOptimize without
+                // spilling the accumulators to memory
+                __asm__ volatile("" : "+v"(increment));
+            }
+
+            for (int chain = 0; chain < PEAK_CHAINS; chain++)
+                benchmark::DoNotOptimize(accumulators[chain]);
+        }
+    }
+    state.SetItemsProcessed((int64_t)threads * iterations * PEAK_CHAINS * PEAK_VECTOR_BYTES * state.iterations());
 }
 
 #define GOL_BENCHMARK_BOARD_SIZES \
@@ -54,11 +458,102 @@ static void BM_SimulateStep(benchmark::State &state, simulate_func simulateFunc)
     {                          \
         1, 2, 3, 4, 5, 6, 7, 8 \
     }
+#define GOL_BENCHMARK_LARGE_BOARD_SIZES \
+    {                                   \
+        1 << 12, 1 << 13                \
+    }
 #define GOL_BENCHMARK_RANGE(Threads) ArgsProduct({GOL_BENCHMARK_BOARD_SIZES, Threads})
 
-BENCHMARK_CAPTURE(BM_SimulateStep, Vanilla_Plain, &simulateStepVanillaPlain)->GOL_BENCHMARK_RANGE({1});
-BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain, &simulateStepOMPPlain)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, Vanilla_Plain, &simulateStepVanillaPlain, BOUNDARY_TORUS, 0, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE({1});
+BENCHMARK_CAPTURE(BM_SimulateStep, Vanilla_Plain_Dead, &simulateStepVanillaPlain, BOUNDARY_DEAD, 0, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE({1});
+BENCHMARK_CAPTURE(BM_SimulateStep, Vanilla_Plain_Reflect, &simulateStepVanillaPlain, BOUNDARY_REFLECT, 0, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE({1});
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain, &simulateStepOMPPlain, BOUNDARY_TORUS, 0, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_Dead, &simulateStepOMPPlain, BOUNDARY_DEAD, 0, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_Reflect, &simulateStepOMPPlain, BOUNDARY_REFLECT, 0, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_Hash, &simulateStepOMPPlain, BOUNDARY_TORUS, TRACK_HASH, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_Statistics, &simulateStepOMPPlain, BOUNDARY_TORUS, TRACK_STATISTICS, FIELD_ALLOCATION_HUGE)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_Calloc, &simulateStepOMPPlain, BOUNDARY_TORUS, 0, FIELD_ALLOCATION_CALLOC)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_Page, &simulateStepOMPPlain, BOUNDARY_TORUS, 0, FIELD_ALLOCATION_PAGE)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_HugeTLB, &simulateStepOMPPlain, BOUNDARY_TORUS, 0, FIELD_ALLOCATION_HUGETLB)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+BENCHMARK(BM_SimulateStepInPlace)->GOL_BENCHMARK_RANGE(GOL_BENCHMARK_THREADS);
+// Row major and tiled layout at 4096^2 and above, where the rows of a segment no longer share pages
+BENCHMARK_CAPTURE(BM_SimulateStep, OMP_Plain_Large, &simulateStepOMPPlain, BOUNDARY_TORUS, 0, FIELD_ALLOCATION_HUGE)->ArgsProduct({GOL_BENCHMARK_LARGE_BOARD_SIZES, GOL_BENCHMARK_THREADS});
+BENCHMARK(BM_SimulateStepTiled)->ArgsProduct({GOL_BENCHMARK_LARGE_BOARD_SIZES, GOL_BENCHMARK_THREADS});
+BENCHMARK(BM_SimulateStepOutput)->ArgsProduct({{1 << 10, 1 << 11}, {0, 16, 64}, {0, 1}, {1, 4, 8}})->UseRealTime();
+BENCHMARK(BM_ComputeViewport)->ArgsProduct({{64, 512}, {16, 256}, GOL_BENCHMARK_THREADS});
+BENCHMARK(BM_SimulateStepSparse)->ArgsProduct({{1 << 12, 1 << 14}, {1, 10}, GOL_BENCHMARK_THREADS});
+BENCHMARK(BM_PeakBandwidth)->ArgsProduct({{1 << 25}, GOL_BENCHMARK_THREADS})->UseRealTime();
+BENCHMARK(BM_PeakCompute)->ArgsProduct({GOL_BENCHMARK_THREADS})->UseRealTime();
+BENCHMARK(BM_SimulateEnsemble)->ArgsProduct({{64, 512}, {64, 256}, GOL_BENCHMARK_THREADS});
 
 #undef BenchmarkRange
 
-BENCHMARK_MAIN();
+// Machine peaks and the dense engines placed on the roofline by src/benchmark.py
+#define GOL_ROOFLINE_BENCHMARKS "BM_Peak|BM_SimulateStep(/Vanilla_Plain/|/OMP_Plain/|/OMP_Plain_Large/|InPlace/|Tiled/)"
+
+// --gol_roofline[=maxThreads]: filter for the roofline benchmarks with at most maxThreads threads (default: all)
+static void rooflineFilter(const char *argument, char *filter, size_t size)
+{
+    int maxThreads = argument[strlen("--gol_roofline")] == '=' ? atoi(argument + strlen("--gol_roofline=")) : 0;
+    if (maxThreads <= 0)
+    {
+        snprintf(filter, size, "--benchmark_filter=^(%s)", GOL_ROOFLINE_BENCHMARKS);
+        return;
+    }
+
+    // The number of threads is the last argument of every roofline benchmark
+    int length = snprintf(filter, size, "--benchmark_filter=^(%s)(.*/)?(1", GOL_ROOFLINE_BENCHMARKS);
+    for (int threads = 2; threads <= maxThreads && length < (int)size; threads++)
+        length += snprintf(filter + length, size - length, "|%d", threads);
+    snprintf(filter + length, size - length, ")(/real_time)?$");
+}
+
+// BENCHMARK_MAIN with --gol_placement=compact|scatter|physical|cpus (see gol_affinity.h), the placement and its CPUs
+// are recorded in the context of the output. --gol_roofline[=maxThreads] runs the roofline benchmarks (see
+// rooflineFilter).
+int main(int argc, char **argv)
+{
+    const char *flag = "--gol_placement=";
+    char roofline[4096];
+    int remaining = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strncmp(argv[i], flag, strlen(flag)) == 0)
+        {
+            if (!selectThreadPlacement(argv[i] + strlen(flag)))
+            {
+                fprintf(stderr, "Unknown thread placement or unavailable CPU: %s\n", argv[i] + strlen(flag));
+                return 1;
+            }
+            continue;
+        }
+        // A later --benchmark_filter still takes precedence
+        if (strncmp(argv[i], "--gol_roofline", strlen("--gol_roofline")) == 0)
+        {
+            rooflineFilter(argv[i], roofline, sizeof(roofline));
+            argv[remaining++] = roofline;
+            continue;
+        }
+        argv[remaining++] = argv[i];
+    }
+    argc = remaining;
+
+    char placement[4096];
+    describeThreadPlacement(placement, sizeof(placement));
+    benchmark::AddCustomContext("gol_placement", placement);
+
+    // dtlb_misses / llc_misses are only reported where perf events can be opened, many VMs and containers do not
+    // expose them
+    int counter = openMissCounter(PERF_COUNT_HW_CACHE_DTLB);
+    benchmark::AddCustomContext("gol_miss_counters", counter >= 0 ? "dtlb_misses llc_misses" : "not measured (perf events unavailable)");
+    if (counter >= 0)
+        close(counter);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    clearFieldPool();
+    return 0;
+}
@@ -2,8 +2,10 @@ from typing import List, Tuple
 from pathlib import Path
 import subprocess
 import os
+import sys
 from io import StringIO
 import math
+import json
 import pickle
 import re
 from datetime import timedelta, datetime
@@ -18,12 +20,14 @@ DIR_SCRIPT = Path(__file__).parent
 DIR_ROOT = DIR_SCRIPT.parent
 
 DIR_BENCHMARKS = DIR_ROOT.joinpath("benchmarks")
+DIR_BENCHMARKS_MPI = DIR_BENCHMARKS.joinpath("mpi")
 DIR_BUILD = DIR_ROOT.joinpath("build")
 DIR_OUTPUT = DIR_ROOT.joinpath("output")
 DIR_PERFORATOR = DIR_ROOT.joinpath("perforator")
 DIR_PLOTS = DIR_ROOT.joinpath("plots")
 
 TEST_COMMAND = f"./{str(DIR_BUILD.joinpath('gameoflife'))}"
+TEST_COMMAND_MPI = f"./{str(DIR_BUILD.joinpath('gameoflife_mpi'))}"
 TEST_FUNCTION = "simulateSteps"
 
 RUNS = 5
@@ -31,6 +35,32 @@ TIMESTEPS = 500  # determined to be >20s and <1min
 
 FIGURE_SIZE = (15, 15)
 
+HALO_DEPTHS = [1, 2, 4, 8, 16, 32]
+HALO_RANKS = [1, 2, 4, 8]
+
+SCALING_TIMESTEPS = 100
+SCALING_STRONG_SIZES = [2048, 4096]  # total board is size x size
+SCALING_WEAK_SIZES = [512, 1024]  # every rank owns size x size, the board grows in height
+SCALING_MAX_CORES = os.cpu_count()
+
+PATH_ROOFLINE = DIR_BENCHMARKS.joinpath("roofline.json")
+ROOFLINE_COMMAND = str(DIR_BUILD.joinpath("benchmark"))
+ROOFLINE_TILE_BYTES = 4416 / 4096  # TILE_CELLS of gol_tiled.h per cell, halo and padding included
+# DRAM bytes and 8 bit operations per cell update of every engine (with ideal reuse of the rows above and below),
+# and bytes of memory per cell of the board:
+# - bytes: read of the current cell, write of the new cell and its write allocate (in place: no write allocate, the
+#   line was just read). BM_PeakBandwidth counts the write allocate of its triad the same way (4 * 8 bytes per
+#   element instead of the 3 * 8 of STREAM).
+# - operations: 7 adds of the neighbor count, 2 compares, and, or
+# - memory: two generations (in place: one)
+ROOFLINE_MODELS = {
+    "Vanilla_Plain": (3, 11, 2),
+    "OMP_Plain": (3, 11, 2),
+    "OMP_Plain_Large": (3, 11, 2),
+    "InPlace": (2, 11, 1),
+    "Tiled": (3 * ROOFLINE_TILE_BYTES, 11, 2 * ROOFLINE_TILE_BYTES),
+}
+
 
 class Benchmark:
     def __init__(self, threads, timesteps, width, height, segments_x=None, segments_y=None):
@@ -84,6 +114,54 @@ class Benchmark:
         return benchmark
 
 
+class MPIBenchmark:
+    def __init__(self, ranks, threads, timesteps, width, height, halo_depth=1):
+        self.ranks: int = ranks
+        self.threads: int = threads
+        self.timesteps: int = timesteps
+        self.width: int = width
+        self.height: int = height
+        self.halo_depth: int = halo_depth
+
+        self.data: pd.DataFrame = None
+
+    @property
+    def runs(self):
+        if self.data is not None:
+            return self.data.shape[0]
+        else:
+            return 0
+
+    def __str__(self):
+        return "<MPIBenchmark ranks={} threads={} timesteps={} width={} height={} halo_depth={} runs={}>".format(
+            self.ranks, self.threads, self.timesteps, self.width, self.height, self.halo_depth, self.runs)
+
+    def save(self, path: Path):
+        path.mkdir(parents=True, exist_ok=True)
+        path_name = "mpi_{}_{}_{}_{}_{}_{}.csv".format(
+            self.ranks, self.threads, self.timesteps, self.width, self.height, self.halo_depth)
+
+        with open(str(path.joinpath(path_name)), "w") as f:
+            f.write(self.data.to_csv())
+
+    @staticmethod
+    def load(file_path: Path) -> object:
+        parts = file_path.name.split(".")[0].split("_")
+        if len(parts) != 7:
+            raise ValueError("The file path does not conform to the standard")
+
+        benchmark = MPIBenchmark(
+            ranks=int(parts[1]),
+            threads=int(parts[2]),
+            timesteps=int(parts[3]),
+            width=int(parts[4]),
+            height=int(parts[5]),
+            halo_depth=int(parts[6]),
+        )
+        benchmark.data = pd.read_csv(str(file_path), index_col=0)
+        return benchmark
+
+
 def build():
     subprocess.call(["make"])
 
@@ -175,6 +253,44 @@ def run_benchmark(benchmark: Benchmark) -> str:
         benchmark.data = df
 
 
+def run_benchmark_mpi(benchmark: MPIBenchmark):
+    # NOTE: eg: mpirun -np 4 ./gameoflife_mpi -H 8 500 1024 1024
+
+    command = [
+        "mpirun",
+        "--oversubscribe",
+        "-np", str(benchmark.ranks),
+        # Open MPI binds small jobs to one core per rank, which would serialize the OpenMP threads of a rank
+        *(["--bind-to", "none"] if benchmark.threads > 1 else []),
+        "-x", "OMP_NUM_THREADS",
+        TEST_COMMAND_MPI,
+        "-H", str(benchmark.halo_depth),
+        str(benchmark.timesteps),
+        str(benchmark.width),
+        str(benchmark.height)
+    ]
+
+    env = dict(os.environ)
+    env.update({"OMP_NUM_THREADS": str(benchmark.threads)})
+
+    # Rank 0 prints a single line: "mpi key=value key=value ..."
+    output = subprocess.check_output(command, env=env).decode("utf-8")
+    data = {}
+    for line in output.split("\n"):
+        if not line.startswith("mpi "):
+            continue
+
+        for pair in line.split()[1:]:
+            key, value = pair.split("=")
+            data[key] = [float(value)]
+
+    df = pd.DataFrame.from_dict(data)
+    if benchmark.data is not None:
+        benchmark.data = benchmark.data.append(df.iloc[0], ignore_index=True)
+    else:
+        benchmark.data = df
+
+
 def calculate_segments(threads: int) -> List[Tuple[int]]:
     # None, None is kept to let our program figure it out
     factors = [(None, None), (1, threads), ]
@@ -215,6 +331,62 @@ def run_benchmarks():
         # break
 
 
+def run_benchmarks_halo():
+    for size in [1024, 2048, 4096]:
+        for ranks in HALO_RANKS:
+            for halo_depth in HALO_DEPTHS:
+                if halo_depth > size // ranks:
+                    continue
+
+                benchmark = MPIBenchmark(
+                    ranks=ranks,
+                    threads=1,
+                    timesteps=TIMESTEPS,
+                    width=size,
+                    height=size,
+                    halo_depth=halo_depth)
+                for _ in range(RUNS):
+                    print("Running benchmark: " + str(benchmark))
+                    run_benchmark_mpi(benchmark)
+                print("Saving benchmark: " + str(benchmark))
+                benchmark.save(DIR_BENCHMARKS_MPI)
+
+
+def scaling_configurations(max_cores: int) -> List[Tuple[int, int]]:
+    """(ranks, threads) with powers of two and ranks * threads <= max_cores"""
+    configurations = []
+    ranks = 1
+    while ranks <= max_cores:
+        threads = 1
+        while ranks * threads <= max_cores:
+            configurations.append((ranks, threads))
+            threads *= 2
+        ranks *= 2
+    return configurations
+
+
+def run_benchmarks_scaling(mode: str, max_cores: int = SCALING_MAX_CORES):
+    """
+    Strong scaling: the total board stays the same for all configurations.
+    Weak scaling: every rank owns a board of the same size, the total board is ranks times higher.
+    """
+    sizes = SCALING_STRONG_SIZES if mode == "strong" else SCALING_WEAK_SIZES
+    for size in sizes:
+        for ranks, threads in scaling_configurations(max_cores):
+            height = size if mode == "strong" else size * ranks
+            benchmark = MPIBenchmark(
+                ranks=ranks,
+                threads=threads,
+                timesteps=SCALING_TIMESTEPS,
+                width=size,
+                height=height)
+            for _ in range(RUNS):
+                print("Running benchmark: " + str(benchmark))
+                run_benchmark_mpi(benchmark)
+            print("Saving benchmark: " + str(benchmark))
+            benchmark.save(DIR_BENCHMARKS_MPI.joinpath(mode))
+
+
 def load_benchmarks() -> List[Benchmark]:
     benchmarks = []
     for file_path in list(DIR_BENCHMARKS.glob("*.csv")):
@@ -374,6 +546,255 @@ def plot_2d_segments_time(benchmarks: List[Benchmark], board_size=1024, y_metric
         plt.show()
 
 
+def load_benchmarks_mpi() -> List[MPIBenchmark]:
+    benchmarks = []
+    for file_path in list(DIR_BENCHMARKS_MPI.glob("mpi_*.csv")):
+        benchmarks.append(MPIBenchmark.load(file_path))
+    return benchmarks
+
+
+def plot_2d_halo_depth(benchmarks: List[MPIBenchmark], y_metric="step", y_label="Step Time", show=False):
+    """
+    2D Plot: Halo Depth vs Step Time
+    ================================
+
+    - x: halo depth (generations per exchange)
+    - y: step time, one line per number of ranks and one subplot per board size
+    """
+    benchmarks = [benchmark for benchmark in benchmarks if benchmark.threads == 1]
+    sizes = sorted(set(benchmark.width for benchmark in benchmarks))
+
+    fig, axes = plt.subplots(len(sizes), 1, figsize=FIGURE_SIZE, squeeze=False)
+    for ax, size in zip(axes[:, 0], sizes):
+        for ranks in sorted(set(benchmark.ranks for benchmark in benchmarks)):
+            selected = sorted([benchmark for benchmark in benchmarks
+                               if benchmark.width == size and benchmark.ranks == ranks],
+                              key=lambda benchmark: benchmark.halo_depth)
+            if not selected:
+                continue
+
+            x = [benchmark.halo_depth for benchmark in selected]
+            y = [benchmark.data[y_metric].mean() for benchmark in selected]
+            y_err = [benchmark.data[y_metric].std() for benchmark in selected]
+            best = int(np.argmin(y))
+
+            ax.errorbar(x, y, yerr=y_err, capsize=5, marker="o", label=f"{ranks} ranks (best h={x[best]})")
+            ax.plot(x[best], y[best], marker="*", markersize=15, color="black")
+            print(f"Board {size}x{size}, {ranks} ranks: best halo depth {x[best]} ({y[best]:.3e} s/step)")
+
+        ax.set_xscale("log", base=2)
+        ax.set_xlabel("Halo Depth")
+        ax.set_ylabel(f"{y_label} (s)")
+        ax.set_title(f"Board Size {size}")
+        ax.legend()
+
+    fig.suptitle("Game of Life MPI Benchmark: Halo Depth vs " + y_label, fontsize=14)
+
+    plt.savefig(str(DIR_PLOTS.joinpath(f"halo_depth_{y_label.lower().replace(' ', '_')}_2d.png")))
+    if show:
+        plt.show()
+
+
+def load_benchmarks_scaling(mode: str) -> List[MPIBenchmark]:
+    benchmarks = []
+    for file_path in list(DIR_BENCHMARKS_MPI.joinpath(mode).glob("mpi_*.csv")):
+        benchmarks.append(MPIBenchmark.load(file_path))
+    return benchmarks
+
+
+def scaling_table(benchmarks: List[MPIBenchmark], mode: str) -> pd.DataFrame:
+    """
+    One row per board and ranks x threads with the mean times of the runs. The baseline of the strong scaling
+    efficiency is 1 rank x 1 thread on the same board (speedup / cores), the baseline of the weak scaling efficiency
+    is 1 rank with the same number of threads (the work per rank stays the same).
+    """
+    rows = []
+    for benchmark in benchmarks:
+        data = benchmark.data
+        rows.append({
+            "size": benchmark.width,
+            "width": benchmark.width,
+            "height": benchmark.height,
+            "ranks": benchmark.ranks,
+            "threads": benchmark.threads,
+            "cores": benchmark.ranks * benchmark.threads,
+            "step": data["step"].mean(),
+            "step_std": data["step"].std(),
+            # Maxima over the ranks, the exchange time includes waiting for slower neighbors
+            "exchange": data["exchange"].mean() / benchmark.timesteps,
+            "compute": data["compute"].mean() / benchmark.timesteps,
+            "messages": data["messages"].mean() / benchmark.timesteps,
+            "bytes": data["bytes"].mean() / benchmark.timesteps,
+        })
+    table = pd.DataFrame(rows).sort_values(["size", "threads", "ranks"], ignore_index=True)
+
+    if mode == "strong":
+        baseline = table[(table.ranks == 1) & (table.threads == 1)].set_index("size")["step"]
+        table["speedup"] = table["size"].map(baseline) / table["step"]
+        table["efficiency"] = table["speedup"] / table["cores"]
+    else:
+        baseline = table[table.ranks == 1].set_index(["size", "threads"])["step"]
+        table["efficiency"] = [baseline.get((size, threads), np.nan) / step
+                               for size, threads, step in zip(table["size"], table["threads"], table["step"])]
+    table["exchange_fraction"] = table["exchange"] / (table["exchange"] + table["compute"])
+    return table
+
+
+def plot_2d_scaling(benchmarks: List[MPIBenchmark], mode: str, show=False):
+    """
+    2D Plot: Cores vs Parallel Efficiency / Exchange Share
+    ======================================================
+
+    - left: parallel efficiency over ranks x threads, one line per number of threads per rank
+    - right: compute and halo exchange time per step of every configuration (stacked)
+    - one row of subplots per board size, the table is written as CSV next to the plot
+    """
+    table = scaling_table(benchmarks, mode)
+    table.to_csv(str(DIR_PLOTS.joinpath(f"scaling_{mode}_efficiency.csv")), index=False)
+    print(table[["size", "height", "ranks", "threads", "step", "exchange", "compute", "messages", "efficiency"]]
+          .to_string(index=False))
+
+    sizes = sorted(table["size"].unique())
+    fig, axes = plt.subplots(len(sizes), 2, figsize=FIGURE_SIZE, squeeze=False)
+    for (ax_efficiency, ax_time), size in zip(axes, sizes):
+        selected = table[table["size"] == size]
+        for threads in sorted(selected["threads"].unique()):
+            line = selected[selected["threads"] == threads]
+            ax_efficiency.plot(line["cores"], line["efficiency"], marker="o", label=f"{threads} threads per rank")
+        ax_efficiency.axhline(1, color="black", linestyle="--", linewidth=1)
+        ax_efficiency.set_xscale("log", base=2)
+        ax_efficiency.set_xlabel("Cores (Ranks x Threads)")
+        ax_efficiency.set_ylabel("Parallel Efficiency")
+        ax_efficiency.set_ylim(bottom=0)
+        board = f"{size}x{size}" if mode == "strong" else f"{size}x{size} per rank"
+        ax_efficiency.set_title(f"Board {board}")
+        ax_efficiency.legend()
+
+        labels = [f"{ranks}x{threads}" for ranks, threads in zip(selected["ranks"], selected["threads"])]
+        ax_time.bar(labels, selected["compute"], label="compute")
+        ax_time.bar(labels, selected["exchange"], bottom=selected["compute"], label="halo exchange")
+        ax_time.set_xlabel("Ranks x Threads")
+        ax_time.set_ylabel("Time per Step (s)")
+        ax_time.set_title(f"Board {board}")
+        ax_time.legend()
+
+    fig.suptitle(f"Game of Life MPI Benchmark: {mode.capitalize()} Scaling ({SCALING_TIMESTEPS} generations)", fontsize=14)
+
+    plt.savefig(str(DIR_PLOTS.joinpath(f"scaling_{mode}_2d.png")))
+    if show:
+        plt.show()
+
+
+def run_benchmarks_roofline(max_threads: int = SCALING_MAX_CORES):
+    # Machine peaks and the engines in a single run of the C++ benchmark, results as Google Benchmark JSON
+    command = [
+        ROOFLINE_COMMAND,
+        f"--gol_roofline={max_threads}",
+        "--benchmark_out_format=json",
+        f"--benchmark_out={PATH_ROOFLINE}",
+    ]
+    subprocess.check_call(command)
+
+
+def last_level_cache_bytes() -> int:
+    # Largest cache of CPU 0 in sysfs (e.g. "32768K"), 0 if unknown
+    largest = 0
+    for index in Path("/sys/devices/system/cpu/cpu0/cache").glob("index*"):
+        size = index.joinpath("size").read_text().strip()
+        units = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+        largest = max(largest, int(size[:-1]) * units[size[-1]] if size[-1] in units else int(size))
+    return largest
+
+
+def roofline_table(path: Path = PATH_ROOFLINE) -> pd.DataFrame:
+    """
+    One row per (engine, board size, threads) of the roofline benchmarks. The peaks are measured with the same number
+    of threads: bandwidth with the STREAM triad (BM_PeakBandwidth, write allocate counted like in ROOFLINE_MODELS),
+    compute with 8 bit SIMD adds (BM_PeakCompute).
+    The attainable throughput is min(compute peak, intensity x bandwidth peak), the engine is memory bound if its
+    intensity is below the ridge point (compute peak / bandwidth peak). Boards whose generations fit into the last
+    level cache (in_cache) do not stream from DRAM and can exceed the bandwidth roof.
+    """
+    with open(str(path)) as f:
+        runs = [run for run in json.load(f)["benchmarks"] if run.get("run_type", "iteration") == "iteration"]
+
+    bandwidth = {}
+    compute = {}
+    rows = []
+    for run in runs:
+        parts = run["name"].replace("/real_time", "").split("/")
+        threads = int(parts[-1])
+        if parts[0] == "BM_PeakBandwidth":
+            bandwidth[threads] = run["bytes_per_second"]
+        elif parts[0] == "BM_PeakCompute":
+            compute[threads] = run["items_per_second"]
+        else:
+            # BM_SimulateStep/<engine>/<size>/<threads>, BM_SimulateStep<engine>/<size>/<threads>
+            engine = parts[1] if parts[0] == "BM_SimulateStep" else parts[0].replace("BM_SimulateStep", "")
+            rows.append({"engine": engine, "size": int(parts[-2]), "threads": threads, "cells": run["items_per_second"]})
+
+    table = pd.DataFrame(rows)
+    table["bytes_per_cell"] = [ROOFLINE_MODELS[engine][0] for engine in table["engine"]]
+    table["ops_per_cell"] = [ROOFLINE_MODELS[engine][1] for engine in table["engine"]]
+    table["intensity"] = table["ops_per_cell"] / table["bytes_per_cell"]
+    table["bandwidth"] = table["cells"] * table["bytes_per_cell"]
+    table["ops"] = table["cells"] * table["ops_per_cell"]
+
+    table["peak_bandwidth"] = table["threads"].map(bandwidth)
+    table["peak_ops"] = table["threads"].map(compute)
+    table["bandwidth_percent"] = 100 * table["bandwidth"] / table["peak_bandwidth"]
+    table["ops_percent"] = 100 * table["ops"] / table["peak_ops"]
+    table["attainable_ops"] = np.minimum(table["peak_ops"], table["intensity"] * table["peak_bandwidth"])
+    table["attainable_percent"] = 100 * table["ops"] / table["attainable_ops"]
+    table["bound"] = np.where(table["intensity"] < table["peak_ops"] / table["peak_bandwidth"], "memory", "compute")
+    table["memory_per_cell"] = [ROOFLINE_MODELS[engine][2] for engine in table["engine"]]
+    table["in_cache"] = table["size"] ** 2 * table["memory_per_cell"] <= last_level_cache_bytes()
+    return table.sort_values(["engine", "size", "threads"], ignore_index=True)
+
+
+def plot_roofline(table: pd.DataFrame, show=False):
+    """
+    Roofline: Operational Intensity vs Operations per Second
+    ========================================================
+
+    - roofs of the peaks with the most threads: bandwidth x intensity up to the ridge point, then the compute peak
+    - one point per (engine, board size, threads), one color per engine, larger markers for more threads, hollow
+      markers for boards that fit into the last level cache
+    - the table is written as CSV next to the plot
+    """
+    table.to_csv(str(DIR_PLOTS.joinpath("roofline.csv")), index=False)
+    print(table[["engine", "size", "threads", "cells", "bandwidth", "bandwidth_percent", "ops", "ops_percent",
+                 "attainable_percent", "bound", "in_cache"]].to_string(index=False))
+
+    threads = table["threads"].max()
+    peak = table[table["threads"] == threads].iloc[0]
+    ridge = peak["peak_ops"] / peak["peak_bandwidth"]
+    intensities = np.logspace(np.log10(table["intensity"].min() / 8), np.log10(max(ridge, table["intensity"].max()) * 8), 200)
+
+    fig, ax = plt.subplots(figsize=FIGURE_SIZE)
+    ax.plot(intensities, np.minimum(peak["peak_ops"], intensities * peak["peak_bandwidth"]), color="black",
+            label=f"Roof ({threads} threads): {peak['peak_bandwidth'] / 1e9:.1f} GB/s, {peak['peak_ops'] / 1e9:.0f} Gop/s")
+    ax.axvline(ridge, color="black", linestyle=":", linewidth=1)
+
+    for engine, color in zip(sorted(table["engine"].unique()), cm.tab10.colors):
+        for in_cache in [False, True]:
+            selected = table[(table["engine"] == engine) & (table["in_cache"] == in_cache)]
+            ax.scatter(selected["intensity"], selected["ops"], s=20 + 20 * selected["threads"], alpha=0.6,
+                       facecolors="none" if in_cache else color, edgecolors=color,
+                       label=f"{engine} (in cache)" if in_cache else engine)
+
+    ax.set_xscale("log")
+    ax.set_yscale("log")
+    ax.set_xlabel("Operational Intensity (8 bit operations / DRAM byte)")
+    ax.set_ylabel("Operations per Second")
+    ax.set_title("Game of Life Roofline (marker size: threads)")
+    ax.legend()
+
+    plt.savefig(str(DIR_PLOTS.joinpath("roofline.png")))
+    if show:
+        plt.show()
+
+
 def visualize_benchmarks(benchmarks: List[Benchmark], show=True):
     plot_3d_thread_size_time(benchmarks, show=show)
     plot_2d_segments_time(benchmarks, board_size=1024, show=show)
@@ -387,5 +808,34 @@ def main():
     visualize_benchmarks(benchmarks)
 
 
+def main_halo():
+    build()
+    run_benchmarks_halo()
+
+    plot_2d_halo_depth(load_benchmarks_mpi(), show=True)
+
+
+def main_scaling(max_cores: int):
+    build()
+    for mode in ["strong", "weak"]:
+        run_benchmarks_scaling(mode, max_cores)
+        plot_2d_scaling(load_benchmarks_scaling(mode), mode, show=False)
+
+
+def main_roofline(max_threads: int):
+    build()
+    run_benchmarks_roofline(max_threads)
+    plot_roofline(roofline_table(), show=False)
+
+
 if __name__ == "__main__":
-    main()
+    if len(sys.argv) > 1 and sys.argv[1] == "halo":
+        main_halo()
+    elif len(sys.argv) > 1 and sys.argv[1] == "roofline":
+        # Optional maximum number of threads, defaults to the number of CPUs
+        main_roofline(int(sys.argv[2]) if len(sys.argv) > 2 else SCALING_MAX_CORES)
+    elif len(sys.argv) > 1 and sys.argv[1] == "scaling":
+        # Optional maximum of ranks x threads, defaults to the number of CPUs
+        main_scaling(int(sys.argv[2]) if len(sys.argv) > 2 else SCALING_MAX_CORES)
+    else:
+        main()
@@ -2,71 +2,563 @@
 #include "gol_vanilla.h"
 #include "gol_omp.h"
 #include "gol_mpi.h"
+#include "gol_sparse.h"
+#include "gol_inplace.h"
+#include "gol_tiled.h"
+#include "gol_ensemble.h"
+#include "gol_cycle.h"
+#include "gol_output.h"
+#include "gol_render.h"
+#include "gol_simulation.h"
+#include "gol_trace.h"
 
-void simulateSteps(int timesteps, struct Field *currentField, struct Field *newField, simulate_func simulateFunction)
+enum Engine
 {
-    long t;
-    for (t = 0; t < timesteps; t++)
+    ENGINE_VANILLA,
+    ENGINE_OMP,
+    ENGINE_SPARSE,  // sparse engine for the whole run
+    ENGINE_AUTO,    // switches between OMP and sparse based on the population density
+    ENGINE_INPLACE, // OpenMP on a single field, half the memory
+    ENGINE_TILED,   // OpenMP on tiles in Z-order (gol_tiled.h)
+};
+
+struct SimulationOptions
+{
+    int timesteps;
+    int width;
+    int height;
+    int segmentsX;
+    int segmentsY;
+
+    enum BoundaryMode boundary;
+    int haloDepth;
+    int rebalanceInterval; // MPI load balancing every n generations, 0 keeps the initial stripes
+    bool rebalanceAlways;  // MPI load balancing applies every change of the stripes (tests the migration)
+    int sharedNodeSize;    // MPI halos through shared memory on a node (of n ranks if n > 0), -1 uses messages only
+    bool verify;           // MPI: compare the final board with the vanilla engine on rank 0, otherwise recount the statistics
+
+    enum Engine engine;
+    double density;    // initial population density, 0 uses fillRandom
+    double densityMax; // ensemble boards sweep from density to densityMax
+    int stripes;       // every n-th row alive instead of a random board, 0 fills randomly
+
+    int boards; // number of independent boards simulated as an ensemble, 0 runs a single board
+
+    int maxPeriod; // detect cycles up to this period and stop early, 0 disables the detection
+
+    const char *statisticsPath; // CSV file for the per generation statistics, NULL disables them
+
+    int outputEvery;  // write every n-th generation as VTK to output/, 0 disables the output
+    int pyramidEvery; // write the density pyramid of every n-th generation to output/, 0 disables them
+    int pyramidLevels;
+
+    double renderFps; // live view in the terminal with at most this frame rate, 0 disables it
+    enum RenderMode renderMode;
+
+    const char *tracePath; // Chrome trace JSON of the OMP segments (builds with USE_TRACE), NULL disables tracing
+};
+
+// Returns the number of generations whose statistics differ from the recount with -V
+long runSimulation(struct SimulationOptions *options)
+{
+    struct Field currentField;
+    struct Field newField;
+    if (options->engine == ENGINE_INPLACE)
+    {
+        // newField is never allocated, it only receives the settings below
+        initializeField(&currentField, options->width, options->height, options->segmentsX, options->segmentsY);
+        newField.field = NULL;
+        newField.buffer.memory = NULL;
+        newField.densities = NULL;
+    }
+    else
+        initializeFields(&currentField, &newField, options->width, options->height, options->segmentsX, options->segmentsY);
+    setBoundaryMode(&currentField, &newField, options->boundary);
+
+    if (options->stripes > 0)
+        fillRowStripes(&currentField, options->stripes);
+    else if (options->density > 0)
+        fillRandomDensity(&currentField, options->density);
+    else
+        fillRandom(&currentField);
+
+    struct SimulationMonitor monitor;
+    initializeSimulationMonitor(&monitor);
+
+    struct CycleDetector detector;
+    if (options->maxPeriod > 0)
+    {
+        initializeCycleDetector(&detector, options->maxPeriod);
+        monitor.detector = &detector;
+        currentField.tracking |= TRACK_HASH;
+        newField.tracking |= TRACK_HASH;
+    }
+
+    if (options->verify)
+    {
+        monitor.verify = true;
+        currentField.tracking |= TRACK_STATISTICS;
+        newField.tracking |= TRACK_STATISTICS;
+    }
+
+    if (options->statisticsPath != NULL)
+    {
+        monitor.statistics = fopen(options->statisticsPath, "w");
+        if (monitor.statistics == NULL)
+        {
+            perror(options->statisticsPath);
+            exit(1);
+        }
+        currentField.tracking |= TRACK_STATISTICS;
+        newField.tracking |= TRACK_STATISTICS;
+    }
+
+    struct OutputPipeline output;
+    if (options->outputEvery > 0 || options->pyramidEvery > 0)
+    {
+        initializeOutputPipeline(&output, &currentField, "output/", options->outputEvery, options->pyramidEvery, options->pyramidLevels,
+                                 OUTPUT_DEFAULT_DEPTH, OUTPUT_DEFAULT_THREADS);
+        monitor.output = &output;
+    }
+
+    struct TerminalRenderer renderer;
+    if (options->renderFps > 0)
+    {
+        initializeTerminalRenderer(&renderer, &currentField, options->renderMode, options->renderFps, 0, 0);
+        monitor.renderer = &renderer;
+    }
+
+    if (options->tracePath != NULL)
+        initializeTracer(omp_get_max_threads(), TRACE_DEFAULT_CAPACITY, currentField.segmentsY);
+
+    struct Field *finalField = &currentField;
+
+    switch (options->engine)
     {
-        simulateFunction(currentField, newField, t);
+    case ENGINE_VANILLA:
+        finalField = simulateSteps(options->timesteps, &currentField, &newField, &simulateStepVanillaPlain, &monitor);
+        break;
+    case ENGINE_OMP:
+        finalField = simulateSteps(options->timesteps, &currentField, &newField, &simulateStepOMPPlain, &monitor);
+        break;
+    case ENGINE_INPLACE:
+        finalField = simulateSteps(options->timesteps, &currentField, &currentField, &simulateStepInPlace, &monitor);
+        break;
+    case ENGINE_SPARSE:
+        simulateStepsAdaptive(options->timesteps, &currentField, &newField, &simulateStepOMPPlain, INFINITY, INFINITY);
+        break;
+    case ENGINE_AUTO:
+        simulateStepsAdaptive(options->timesteps, &currentField, &newField, &simulateStepOMPPlain,
+                              SPARSE_DENSITY_ENTER, SPARSE_DENSITY_LEAVE);
+        break;
+    case ENGINE_TILED:
+        simulateStepsTiled(options->timesteps, &currentField);
+        break;
+    }
+
+    if (monitor.renderer != NULL)
+        finishTerminalRenderer(&renderer, finalField, monitor.generation);
+
+    if (monitor.detector != NULL)
+    {
+        if (detector.period > 0)
+            printf("Cycle detected: generation %ld period %d\n", detector.generation, detector.period);
+        freeCycleDetector(&detector);
+    }
+    if (monitor.statistics != NULL)
+        fclose(monitor.statistics);
+    if (monitor.verify)
+        printf("verify=%s mismatches=%ld\n", monitor.mismatches == 0 ? "ok" : "failed", monitor.mismatches);
+    if (monitor.output != NULL)
+    {
+        finishOutputPipeline(&output);
+        printf("Output: %ld generations written (%ld bytes), copy %fs, waited for I/O %fs\n", output.written, output.bytesWritten,
+               output.copyTime, output.stallTime);
+    }
+    if (options->tracePath != NULL)
+    {
+        FILE *trace = fopen(options->tracePath, "w");
+        if (trace == NULL)
+        {
+            perror(options->tracePath);
+            exit(1);
+        }
+        writeTraceJSON(trace);
+        fclose(trace);
+
+        printTraceSummary(stdout);
+        freeTracer();
+    }
 
 #ifdef DEBUG
-        printf("Timestep: %ld\n", t);
-        show(&currentField);
-        usleep(200000);
+    printf("Done\n");
 #endif
 
-        // SWAP
-        struct Field *temp = currentField;
-        currentField = newField;
-        newField = temp;
+    freeField(&currentField);
+    freeField(&newField);
+    return monitor.mismatches;
+}
+
+void runEnsemble(struct SimulationOptions *options)
+{
+    struct Ensemble ensemble;
+    initializeEnsemble(&ensemble, options->boards, options->width, options->height, options->boundary);
+
+    // Board i uses seed i and a density linearly interpolated between density and densityMax
+    double density = options->density > 0 ? options->density : 0.1;
+    double densityMax = options->densityMax > 0 ? options->densityMax : density;
+    double *densities = (double *)malloc(options->boards * sizeof(double));
+    for (int i = 0; i < options->boards; i++)
+    {
+        densities[i] = density + (densityMax - density) * i / MAX(options->boards - 1, 1);
+        ensembleFillRandom(&ensemble, i, i, densities[i]);
+    }
+
+    simulateEnsemble(&ensemble, options->timesteps);
+
+    struct FieldStatistics *statistics = (struct FieldStatistics *)malloc(options->boards * sizeof(struct FieldStatistics));
+    ensembleStatistics(&ensemble, statistics);
+
+    printf("board,seed,density,population,births,deaths,min_x,min_y,max_x,max_y\n");
+    for (int i = 0; i < options->boards; i++)
+    {
+        struct FieldStatistics *board = &statistics[i];
+        printf("%d,%d,%f,%ld,%ld,%ld,%d,%d,%d,%d\n", i, i, densities[i], board->population, board->births, board->deaths,
+               board->minX, board->minY, board->maxX, board->maxY);
+    }
+
+    // Final generation of every board as VTK, unpacked from its lane
+    if (options->outputEvery > 0)
+    {
+        struct Field board;
+        initializeField(&board, options->width, options->height, 1, 1);
+        char pathPrefix[1024] = "output/";
+        mkdir(pathPrefix, 0755);
+        for (int i = 0; i < options->boards; i++)
+        {
+            char prefix[1024];
+            snprintf(prefix, sizeof(prefix), "gol_ensemble_%05d_%05d", i, options->timesteps);
+            ensembleGetBoard(&ensemble, i, &board);
+            writeVTK2(&board, pathPrefix, prefix, 0, board.width, 0, board.height);
+            writeVTK2Master(&board, pathPrefix, prefix);
+        }
+        freeField(&board);
     }
+
+    free(statistics);
+    free(densities);
+    freeEnsemble(&ensemble);
 }
 
-void runSimulation(int timesteps, int width, int height, int segmentsX, int segmentsY)
+#ifdef USE_MPI
+// Returns the number of cells that differ from the vanilla engine with -V (on rank 0, 0 otherwise)
+long runSimulationMPI(struct SimulationOptions *options)
 {
-    struct Field currentField;
-    struct Field newField;
-    initializeFields(&currentField, &newField, width, height, segmentsX, segmentsY);
+    struct FieldMPI field;
+    initializeFieldMPI(&field, MPI_COMM_WORLD, options->width, options->height, options->boundary, options->haloDepth);
+    field.rebalanceInterval = options->rebalanceInterval;
+    field.rebalanceAlways = options->rebalanceAlways;
+    if (options->sharedNodeSize >= 0)
+        enableSharedHalosMPI(&field, options->sharedNodeSize);
 
-    fillRandom(&currentField);
-    simulateSteps(timesteps, &currentField, &newField, &simulateStepOMPPlain);
+    // The initial board is generated on rank 0 and distributed row wise
+    struct Field global;
+    global.field = NULL;
+    global.buffer.memory = NULL;
+    global.densities = NULL;
+    if (field.rank == 0)
+    {
+        initializeField(&global, options->width, options->height, 1, 1);
+        if (options->stripes > 0)
+            fillRowStripes(&global, options->stripes);
+        else
+            fillRandom(&global);
+    }
+    scatterFieldMPI(&field, &global);
 
-#ifdef DEBUG
-    printf("Done\n");
+    // The reference run starts from the same board
+    struct Field reference[2];
+    if (options->verify && field.rank == 0)
+    {
+        initializeFields(&reference[0], &reference[1], options->width, options->height, 1, 1);
+        setBoundaryMode(&reference[0], &reference[1], options->boundary);
+        memcpy(reference[0].field, global.field, (size_t)options->width * options->height * sizeof(FieldType));
+    }
+
+    MPI_Barrier(field.comm);
+    double start = MPI_Wtime();
+    simulateStepsMPI(options->timesteps, &field);
+    double elapsed = MPI_Wtime() - start;
+
+    printStatisticsMPI(&field, options->timesteps, elapsed);
+
+    long differences = 0;
+    if (options->verify)
+    {
+        gatherFieldMPI(&field, &global);
+        if (field.rank == 0)
+        {
+            struct Field *expected = simulateSteps(options->timesteps, &reference[0], &reference[1], &simulateStepVanillaPlain, NULL);
+            for (long i = 0; i < (long)options->width * options->height; i++)
+                differences += global.field[i] != expected->field[i];
+            printf("verify=%s differences=%ld\n", differences == 0 ? "ok" : "failed", differences);
+
+            freeField(&reference[0]);
+            freeField(&reference[1]);
+        }
+    }
+
+    freeField(&global);
+    freeFieldMPI(&field);
+    return differences;
+}
 #endif
 
-    free(currentField.field);
-    free(newField.field);
+// Returns -1 if the name is unknown
+static int parseEngine(const char *name)
+{
+    if (strcmp(name, "vanilla") == 0)
+        return ENGINE_VANILLA;
+    if (strcmp(name, "omp") == 0)
+        return ENGINE_OMP;
+    if (strcmp(name, "sparse") == 0)
+        return ENGINE_SPARSE;
+    if (strcmp(name, "auto") == 0)
+        return ENGINE_AUTO;
+    if (strcmp(name, "inplace") == 0)
+        return ENGINE_INPLACE;
+    if (strcmp(name, "tiled") == 0)
+        return ENGINE_TILED;
+    return -1;
+}
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [options] [timesteps] [width] [height] [segmentsX] [segmentsY]\n", program);
+    fprintf(stderr, "  -b torus|dead|reflect       boundary condition (default: torus)\n");
+    fprintf(stderr, "  -e vanilla|omp|sparse|auto|inplace|tiled  engine, inplace needs a single field, tiled stores Z-ordered tiles (default: omp)\n");
+    fprintf(stderr, "  -p density[:max]|rows:n     initial population density, a range sweeps the boards (default: 0.1), rows:n fills every n-th row of a single board\n");
+    fprintf(stderr, "  -n boards                   simulate independent boards as a bit sliced ensemble, prints CSV, -o writes the final boards\n");
+    fprintf(stderr, "  -c period                   stop once the board repeats with a period <= period (vanilla/omp/inplace)\n");
+    fprintf(stderr, "  -s file.csv                 write population, births, deaths and bounding box per generation (vanilla/omp/inplace)\n");
+    fprintf(stderr, "  -o n                        write every n-th generation as VTK to output/ in the background (vanilla/omp/inplace)\n");
+    fprintf(stderr, "  -l n[:levels]               write 4x4, 16x16, ... block densities of every n-th generation (default: 3 levels)\n");
+    fprintf(stderr, "  -r fps[:braille|half]       live view in the terminal, downsampled to its size (vanilla/omp/inplace)\n");
+    fprintf(stderr, "  -H depth                    MPI halo depth, generations computed per exchange (default: 1)\n");
+    fprintf(stderr, "  -B n[:always]               MPI load balancing, moves the stripe borders every n generations if it pays off (always: on every change)\n");
+    fprintf(stderr, "  -S n                        MPI halos of ranks on the same node through shared memory, n > 0 emulates nodes of n ranks\n");
+    fprintf(stderr, "  -V                          recount the statistics of every generation (vanilla/omp), MPI: compare the final board with\n");
+    fprintf(stderr, "                              the vanilla engine, exit status 1 on differences\n");
+    fprintf(stderr, "  -m calloc|aligned|page|huge|hugetlb  field memory, huge uses 2 MiB pages (default: huge)\n");
+    fprintf(stderr, "  -a compact|scatter|physical|cpus  pin the OpenMP threads, cpus is a list like 0,2,4-7 (default: none), MPI ranks\n");
+    fprintf(stderr, "                              of a node that share their CPUs split them\n");
+    fprintf(stderr, "  -T trace.json               per thread timeline of the omp engine and imbalance per step (make build-gol-trace)\n");
 }
 
 int main(int c, char **argv)
 {
-    int timesteps = 0, width = 0, height = 0, segmentsX = 0, segmentsY = 0;
+    struct SimulationOptions options = {0};
+    options.boundary = BOUNDARY_TORUS;
+    options.haloDepth = 1;
+    options.engine = ENGINE_OMP;
+    options.pyramidLevels = 3;
+    options.sharedNodeSize = -1;
+
+    int opt;
+    while ((opt = getopt(c, argv, "b:e:p:n:c:s:o:l:r:H:B:S:Vm:a:T:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+        {
+            int boundary = parseBoundaryMode(optarg);
+            if (boundary < 0)
+            {
+                fprintf(stderr, "Unknown boundary mode: %s\n", optarg);
+                printUsage(argv[0]);
+                return 1;
+            }
+            options.boundary = (enum BoundaryMode)boundary;
+            break;
+        }
+        case 'e':
+        {
+            int engine = parseEngine(optarg);
+            if (engine < 0)
+            {
+                fprintf(stderr, "Unknown engine: %s\n", optarg);
+                printUsage(argv[0]);
+                return 1;
+            }
+            options.engine = (enum Engine)engine;
+            break;
+        }
+        case 'p':
+        {
+            if (strncmp(optarg, "rows:", 5) == 0)
+            {
+                options.stripes = atoi(optarg + 5);
+                break;
+            }
+            char *separator = strchr(optarg, ':');
+            options.density = atof(optarg);
+            if (separator != NULL)
+                options.densityMax = atof(separator + 1);
+            break;
+        }
+        case 'n':
+            options.boards = atoi(optarg);
+            break;
+        case 'c':
+            options.maxPeriod = atoi(optarg);
+            break;
+        case 's':
+            options.statisticsPath = optarg;
+            break;
+        case 'o':
+            options.outputEvery = atoi(optarg);
+            break;
+        case 'l':
+        {
+            char *separator = strchr(optarg, ':');
+            options.pyramidEvery = atoi(optarg);
+            if (separator != NULL)
+                options.pyramidLevels = atoi(separator + 1);
+            break;
+        }
+        case 'r':
+        {
+            char *separator = strchr(optarg, ':');
+            options.renderFps = atof(optarg);
+            if (separator != NULL && strcmp(separator + 1, "half") == 0)
+                options.renderMode = RENDER_HALF_BLOCK;
+            else if (separator != NULL && strcmp(separator + 1, "braille") != 0)
+            {
+                fprintf(stderr, "Unknown render mode: %s\n", separator + 1);
+                printUsage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case 'H':
+            options.haloDepth = atoi(optarg);
+            break;
+        case 'B':
+        {
+            char *separator = strchr(optarg, ':');
+            options.rebalanceInterval = atoi(optarg);
+            if (separator != NULL && strcmp(separator + 1, "always") == 0)
+                options.rebalanceAlways = true;
+            else if (separator != NULL)
+            {
+                fprintf(stderr, "Unknown load balancing mode: %s\n", separator + 1);
+                printUsage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case 'S':
+            options.sharedNodeSize = atoi(optarg);
+            break;
+        case 'V':
+            options.verify = true;
+            break;
+        case 'm':
+        {
+            int allocation = parseFieldAllocation(optarg);
+            if (allocation < 0)
+            {
+                fprintf(stderr, "Unknown field allocation: %s\n", optarg);
+                printUsage(argv[0]);
+                return 1;
+            }
+            setFieldAllocation((enum FieldAllocation)allocation, true);
+            break;
+        }
+        case 'a':
+            if (!selectThreadPlacement(optarg))
+            {
+                fprintf(stderr, "Unknown thread placement or unavailable CPU: %s\n", optarg);
+                printUsage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'T':
+#ifndef USE_TRACE
+            fprintf(stderr, "Tracing (-T) requires a build with USE_TRACE (make build-gol-trace)\n");
+            return 1;
+#endif
+            options.tracePath = optarg;
+            break;
+        default:
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
 
     // 500 1024 1024 takes about 25s on one thread
 
-    // Read width
-    if (c > 1)
-        timesteps = atoi(argv[1]);
-    if (c > 2)
-        width = atoi(argv[2]);
-    if (c > 3)
-        height = atoi(argv[2]);
-    if (c > 4)
-        segmentsX = atoi(argv[2]);
-    if (c > 5)
-        segmentsY = atoi(argv[2]);
+    // Positional arguments: timesteps width height segmentsX segmentsY
+    int positional = c - optind;
+    char **args = argv + optind;
+    if (positional > 0)
+        options.timesteps = atoi(args[0]);
+    if (positional > 1)
+        options.width = atoi(args[1]);
+    if (positional > 2)
+        options.height = atoi(args[2]);
+    if (positional > 3)
+        options.segmentsX = atoi(args[3]);
+    if (positional > 4)
+        options.segmentsY = atoi(args[4]);
+
+    if ((options.maxPeriod > 0 || options.statisticsPath != NULL || options.outputEvery > 0 || options.pyramidEvery > 0 ||
+         options.renderFps > 0) &&
+        options.engine != ENGINE_VANILLA && options.engine != ENGINE_OMP && options.engine != ENGINE_INPLACE)
+    {
+        fprintf(stderr, "Cycle detection (-c), statistics (-s), output (-o, -l) and the live view (-r) require the vanilla, omp or inplace engine\n");
+        return 1;
+    }
+#ifndef USE_MPI
+    if (options.verify && (options.boards > 0 || (options.engine != ENGINE_VANILLA && options.engine != ENGINE_OMP)))
+    {
+        fprintf(stderr, "Verifying the statistics (-V) requires a single board and the vanilla or omp engine\n");
+        return 1;
+    }
+#endif
+    if (options.tracePath != NULL && options.engine != ENGINE_OMP && options.engine != ENGINE_AUTO)
+    {
+        fprintf(stderr, "Tracing (-T) requires the omp or auto engine\n");
+        return 1;
+    }
 
     // Default values
-    if (timesteps <= 0)
-        timesteps = 100;
-    if (width <= 0)
-        width = 30;
-    if (height <= 0)
-        height = 30;
+    if (options.timesteps <= 0)
+        options.timesteps = 100;
+    if (options.width <= 0)
+        options.width = 30;
+    if (options.height <= 0)
+        options.height = 30;
 
-    runSimulation(timesteps, width, height, segmentsX, segmentsY);
+    int status = 0;
+#ifdef USE_MPI
+    MPI_Init(&c, &argv);
+    applyThreadPlacementMPI(MPI_COMM_WORLD);
+    if (runSimulationMPI(&options) > 0)
+        status = 1;
+    MPI_Finalize();
+#else
+    // One thread per listed / physical core unless the number of threads is given, before the fields are segmented
+    if ((threadAffinity.placement == PLACEMENT_PHYSICAL || threadAffinity.placement == PLACEMENT_LIST) && getenv("OMP_NUM_THREADS") == NULL)
+        omp_set_num_threads(threadAffinity.count);
+    applyThreadPlacement(0);
+
+    if (options.boards > 0)
+        runEnsemble(&options);
+    else if (runSimulation(&options) > 0)
+        status = 1;
+#endif
 
-    return 0;
+    clearFieldPool();
+    return status;
 }
@@ -0,0 +1,341 @@
+#ifndef GOL_AFFINITY
+#define GOL_AFFINITY
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <omp.h>
+
+//
+// Thread Placement
+//
+// Pins the OpenMP threads to CPUs chosen from the topology in sysfs (/sys/devices/system/cpu/cpuN/topology), so
+// thread sweeps always use the same cores, hyperthreads and sockets. Only CPUs in the affinity mask of the process
+// are used. Thread i runs on cpus[i % count]:
+//
+// - compact:  fills a core (all its hyperthreads) and a socket before the next one
+// - scatter:  one thread per socket in turn, then the next core of every socket, hyperthreads last
+// - physical: one hyperthread per core (compact order)
+// - list:     explicit CPU list, e.g. 0,2,4-7
+//
+// The OMP engine hands out its segments in topology order instead of thread numbers (segmentRank), so neighboring
+// segments run on hyperthreads of the same core or at least on the same socket and share the caches of their
+// common rows.
+//
+// Newly created OpenMP threads inherit the affinity of the master thread, applyThreadPlacement has to be called again
+// whenever the number of threads changes. The placement is selected once before that, the affinity mask of the
+// process is restricted to the CPU of the master thread afterwards. The state is global like the field allocator.
+// The affinity masks are set with the raw system calls, the glibc wrappers need _GNU_SOURCE.
+//
+
+#define PLACEMENT_MAX_CPUS 1024
+#define PLACEMENT_MASK_WORDS (PLACEMENT_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+enum ThreadPlacement
+{
+    PLACEMENT_NONE, // scheduled by the operating system
+    PLACEMENT_COMPACT,
+    PLACEMENT_SCATTER,
+    PLACEMENT_PHYSICAL,
+    PLACEMENT_LIST,
+};
+
+struct CpuTopology
+{
+    int cpu;
+    int package;
+    int core;     // core_id, only unique within a package
+    int smt;      // index of the hyperthread within its core
+    int coreRank; // index of the core within its package
+};
+
+struct ThreadAffinity
+{
+    enum ThreadPlacement placement;
+    int count;
+    int cpus[PLACEMENT_MAX_CPUS];     // placement order
+    int cpuRanks[PLACEMENT_MAX_CPUS]; // position of cpus[i] in compact topology order
+    unsigned long processMask[PLACEMENT_MASK_WORDS]; // affinity mask of the process before any thread was pinned
+
+    int rankedThreads;             // number of threads ranks was computed for, 0 if none
+    int ranks[PLACEMENT_MAX_CPUS]; // position of thread i in topology order
+};
+
+static struct ThreadAffinity threadAffinity = {PLACEMENT_NONE};
+
+static const char *threadPlacementNames[] = {"none", "compact", "scatter", "physical", "list"};
+
+// Reads a single integer from a sysfs file, fallback if it does not exist
+static inline int readTopologyValue(int cpu, const char *name, int fallback)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return fallback;
+
+    int value = fallback;
+    if (fscanf(file, "%d", &value) != 1)
+        value = fallback;
+    fclose(file);
+    return value;
+}
+
+static int compareTopologyCompact(const void *a, const void *b)
+{
+    const struct CpuTopology *x = (const struct CpuTopology *)a;
+    const struct CpuTopology *y = (const struct CpuTopology *)b;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int compareTopologyScatter(const void *a, const void *b)
+{
+    const struct CpuTopology *x = (const struct CpuTopology *)a;
+    const struct CpuTopology *y = (const struct CpuTopology *)b;
+    if (x->smt != y->smt)
+        return x->smt - y->smt;
+    if (x->coreRank != y->coreRank)
+        return x->coreRank - y->coreRank;
+    return x->package - y->package;
+}
+
+// Topology of the CPUs the process may run on, sorted by package, core and hyperthread. Returns the number of CPUs.
+static inline int readCpuTopology(struct CpuTopology *topology, unsigned long *allowed)
+{
+    memset(allowed, 0, PLACEMENT_MASK_WORDS * sizeof(unsigned long));
+    if (syscall(SYS_sched_getaffinity, 0, PLACEMENT_MASK_WORDS * sizeof(unsigned long), allowed) < 0)
+        return 0;
+
+    int count = 0;
+    int bits = 8 * sizeof(unsigned long);
+    for (int cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++)
+    {
+        if (!(allowed[cpu / bits] >> (cpu % bits) & 1))
+            continue;
+
+        topology[count].cpu = cpu;
+        topology[count].package = readTopologyValue(cpu, "physical_package_id", 0);
+        topology[count].core = readTopologyValue(cpu, "core_id", cpu);
+        count++;
+    }
+
+    qsort(topology, count, sizeof(struct CpuTopology), compareTopologyCompact);
+    for (int i = 0; i < count; i++)
+    {
+        bool samePackage = i > 0 && topology[i].package == topology[i - 1].package;
+        bool sameCore = samePackage && topology[i].core == topology[i - 1].core;
+        topology[i].smt = sameCore ? topology[i - 1].smt + 1 : 0;
+        topology[i].coreRank = !samePackage ? 0 : topology[i - 1].coreRank + !sameCore;
+    }
+    return count;
+}
+
+// Parses a CPU list like 0,2,4-7 into cpus, returns the number of CPUs or -1 if the list is malformed
+static inline int parseCpuList(const char *list, int *cpus)
+{
+    int count = 0;
+    const char *position = list;
+    while (*position != '\0')
+    {
+        char *end;
+        long first = strtol(position, &end, 10);
+        if (end == position || first < 0)
+            return -1;
+
+        long last = first;
+        if (*end == '-')
+        {
+            position = end + 1;
+            last = strtol(position, &end, 10);
+            if (end == position || last < first)
+                return -1;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (count == PLACEMENT_MAX_CPUS || cpu >= PLACEMENT_MAX_CPUS)
+                return -1;
+            cpus[count++] = cpu;
+        }
+
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        position = end;
+    }
+    return count;
+}
+
+// Position of cpu in compact topology order, -1 if unknown
+static inline int topologyRank(const struct CpuTopology *topology, int available, int cpu)
+{
+    for (int i = 0; i < available; i++)
+    {
+        if (topology[i].cpu == cpu)
+            return i;
+    }
+    return -1;
+}
+
+// Selects the placement by name (none, compact, scatter, physical) or CPU list. Returns false if the name is unknown
+// or a listed CPU is not available to the process.
+static inline bool selectThreadPlacement(const char *name)
+{
+    enum ThreadPlacement placement = PLACEMENT_LIST;
+    for (int i = PLACEMENT_NONE; i < PLACEMENT_LIST; i++)
+    {
+        if (strcmp(name, threadPlacementNames[i]) == 0)
+            placement = (enum ThreadPlacement)i;
+    }
+
+    struct CpuTopology *topology = (struct CpuTopology *)malloc(PLACEMENT_MAX_CPUS * sizeof(struct CpuTopology));
+    unsigned long allowed[PLACEMENT_MASK_WORDS];
+    int available = readCpuTopology(topology, allowed);
+
+    int cpus[PLACEMENT_MAX_CPUS];
+    int count = 0;
+    switch (placement)
+    {
+    case PLACEMENT_NONE:
+        break;
+    case PLACEMENT_SCATTER:
+    {
+        struct CpuTopology *scattered = (struct CpuTopology *)malloc(available * sizeof(struct CpuTopology));
+        memcpy(scattered, topology, available * sizeof(struct CpuTopology));
+        qsort(scattered, available, sizeof(struct CpuTopology), compareTopologyScatter);
+        for (int i = 0; i < available; i++)
+            cpus[count++] = scattered[i].cpu;
+        free(scattered);
+        break;
+    }
+    case PLACEMENT_COMPACT:
+        for (int i = 0; i < available; i++)
+            cpus[count++] = topology[i].cpu;
+        break;
+    case PLACEMENT_PHYSICAL:
+        for (int i = 0; i < available; i++)
+        {
+            if (topology[i].smt == 0)
+                cpus[count++] = topology[i].cpu;
+        }
+        break;
+    case PLACEMENT_LIST:
+        count = parseCpuList(name, cpus);
+        for (int i = 0; i < count; i++)
+        {
+            if (topologyRank(topology, available, cpus[i]) < 0)
+                count = -1;
+        }
+        break;
+    }
+
+    if (count < 0 || (count == 0 && placement != PLACEMENT_NONE))
+    {
+        free(topology);
+        return false;
+    }
+
+    threadAffinity.placement = placement;
+    threadAffinity.count = count;
+    memcpy(threadAffinity.processMask, allowed, sizeof(allowed));
+    for (int i = 0; i < count; i++)
+    {
+        threadAffinity.cpus[i] = cpus[i];
+        threadAffinity.cpuRanks[i] = topologyRank(topology, available, cpus[i]);
+    }
+    free(topology);
+    threadAffinity.rankedThreads = 0;
+    return true;
+}
+
+// Keeps the part-th of parts equal shares of the selected CPUs, so several processes on the same CPUs (e.g. MPI ranks
+// of a node that mpirun did not bind) pin their threads to different CPUs. With more parts than CPUs the parts share
+// single CPUs.
+static inline void restrictThreadPlacement(int part, int parts)
+{
+    if (threadAffinity.placement == PLACEMENT_NONE || parts <= 1)
+        return;
+
+    int first = (long)threadAffinity.count * part / parts;
+    int end = (long)threadAffinity.count * (part + 1) / parts;
+    if (end == first)
+    {
+        first = part % threadAffinity.count;
+        end = first + 1;
+    }
+
+    threadAffinity.count = end - first;
+    memmove(threadAffinity.cpus, threadAffinity.cpus + first, threadAffinity.count * sizeof(int));
+    memmove(threadAffinity.cpuRanks, threadAffinity.cpuRanks + first, threadAffinity.count * sizeof(int));
+    threadAffinity.rankedThreads = 0;
+}
+
+// Pins the threads of the next parallel regions with threads threads (0: omp_get_max_threads) and ranks them
+static inline void applyThreadPlacement(int threads)
+{
+    if (threadAffinity.placement == PLACEMENT_NONE)
+        return;
+    if (threads <= 0)
+        threads = omp_get_max_threads();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int cpu = threadAffinity.cpus[omp_get_thread_num() % threadAffinity.count];
+        int bits = 8 * sizeof(unsigned long);
+        unsigned long mask[PLACEMENT_MASK_WORDS] = {0};
+        mask[cpu / bits] = 1UL << (cpu % bits);
+        syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+    }
+
+    // Threads sharing a CPU (more threads than CPUs) keep the order of their thread numbers
+    int ranked = threads < PLACEMENT_MAX_CPUS ? threads : PLACEMENT_MAX_CPUS;
+    long *keys = (long *)malloc(ranked * sizeof(long));
+    for (int t = 0; t < ranked; t++)
+    {
+        keys[t] = (long)threadAffinity.cpuRanks[t % threadAffinity.count] * PLACEMENT_MAX_CPUS + t;
+    }
+    for (int t = 0; t < ranked; t++)
+    {
+        threadAffinity.ranks[t] = 0;
+        for (int u = 0; u < ranked; u++)
+            threadAffinity.ranks[t] += keys[u] < keys[t];
+    }
+    threadAffinity.rankedThreads = ranked;
+
+    free(keys);
+}
+
+// Lets a helper thread (I/O, rendering) run on all CPUs of the process again instead of the CPU of the master thread
+// it inherited
+static inline void unpinThread(void)
+{
+    if (threadAffinity.placement != PLACEMENT_NONE)
+        syscall(SYS_sched_setaffinity, 0, sizeof(threadAffinity.processMask), threadAffinity.processMask);
+}
+
+// Position of the calling thread in topology order, the thread number if no placement is applied for this team
+static inline int segmentRank(void)
+{
+    int thread = omp_get_thread_num();
+    if (threadAffinity.rankedThreads != omp_get_num_threads())
+        return thread;
+    return threadAffinity.ranks[thread];
+}
+
+// Placement name and the CPUs of the threads in order, e.g. "scatter:0,8,1,9"
+static inline void describeThreadPlacement(char *description, size_t size)
+{
+    int length = snprintf(description, size, "%s", threadPlacementNames[threadAffinity.placement]);
+    for (int i = 0; i < threadAffinity.count && length < (int)size; i++)
+        length += snprintf(description + length, size - length, "%c%d", i == 0 ? ':' : ',', threadAffinity.cpus[i]);
+}
+
+#endif // GOL_AFFINITY
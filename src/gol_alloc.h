@@ -0,0 +1,231 @@
+#ifndef GOL_ALLOC
+#define GOL_ALLOC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//
+// Field Allocator
+//
+// Field buffers are cache line aligned, page aligned or backed by 2 MiB huge pages. Huge pages remove most of the
+// minor page faults and TLB misses of large boards: a 4096 x 4096 field needs 4096 pages of 4 KiB but only 8 of
+// 2 MiB. Released buffers are kept in a small pool and handed out again for a field of the same size, so repeated
+// runs (e.g. the benchmark configurations) reuse memory that is already mapped and faulted in. clearFieldPool
+// releases the pool at the end of the programs and in golReleaseMemory of the library.
+//
+// Huge page buffers start alternately at offset 0 and FIELD_COLOR_OFFSET of their mapping. Otherwise the current
+// and the new field share the low address bits of every cell, so the stores to the new field alias the loads from
+// the current one (4K aliasing, cache set conflicts) and the OMP engine runs at half speed on 4096 x 4096. The
+// offset is no multiple of 512, so it does not line up with the rows of power of two widths either.
+//
+// The allocator state is global and not thread safe, fields are only allocated outside of parallel regions.
+//
+
+#define FIELD_ALIGNMENT 64
+#define FIELD_HUGE_PAGE_SIZE (2UL << 20)
+#define FIELD_POOL_CAPACITY 8
+#define FIELD_COLOR_OFFSET 2624
+
+enum FieldAllocation
+{
+    FIELD_ALLOCATION_CALLOC,  // plain calloc, no alignment guarantees
+    FIELD_ALLOCATION_ALIGNED, // FIELD_ALIGNMENT (cache line) aligned
+    FIELD_ALLOCATION_PAGE,    // page aligned anonymous mapping
+    FIELD_ALLOCATION_HUGE,    // 2 MiB aligned mapping with transparent huge pages (madvise), smaller fields are page aligned
+    FIELD_ALLOCATION_HUGETLB, // explicit huge pages (MAP_HUGETLB), falls back to FIELD_ALLOCATION_HUGE
+};
+
+struct FieldBuffer
+{
+    void *memory;
+    size_t size; // requested bytes
+
+    void *allocated; // start of the allocation, memory may be offset by FIELD_COLOR_OFFSET
+    size_t bytes;    // allocated bytes (rounded up to the page size for mappings)
+
+    enum FieldAllocation allocation; // requested allocation, buffers are only reused for the same one
+    bool mapped;                     // memory is released with munmap instead of free
+};
+
+struct FieldAllocator
+{
+    enum FieldAllocation allocation;
+    bool pooling;
+
+    int pooled;
+    struct FieldBuffer pool[FIELD_POOL_CAPACITY];
+
+    int hugeBuffers; // number of allocated huge page buffers, selects the offset of the next one
+};
+
+static struct FieldAllocator fieldAllocator = {FIELD_ALLOCATION_HUGE, true};
+
+static inline void setFieldAllocation(enum FieldAllocation allocation, bool pooling)
+{
+    fieldAllocator.allocation = allocation;
+    fieldAllocator.pooling = pooling;
+}
+
+// Returns -1 if the name is unknown
+static inline int parseFieldAllocation(const char *name)
+{
+    if (strcmp(name, "calloc") == 0)
+        return FIELD_ALLOCATION_CALLOC;
+    if (strcmp(name, "aligned") == 0)
+        return FIELD_ALLOCATION_ALIGNED;
+    if (strcmp(name, "page") == 0)
+        return FIELD_ALLOCATION_PAGE;
+    if (strcmp(name, "huge") == 0)
+        return FIELD_ALLOCATION_HUGE;
+    if (strcmp(name, "hugetlb") == 0)
+        return FIELD_ALLOCATION_HUGETLB;
+    return -1;
+}
+
+static inline size_t roundUpFieldBytes(size_t bytes, size_t alignment)
+{
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+// Maps bytes (a multiple of the page size) aligned to alignment by trimming an oversized mapping, NULL on failure
+static inline void *mapFieldMemory(size_t bytes, size_t alignment, int flags)
+{
+    size_t mappedBytes = bytes + alignment - (size_t)sysconf(_SC_PAGESIZE);
+    char *mapped = (char *)mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    char *aligned = (char *)roundUpFieldBytes((uintptr_t)mapped, alignment);
+    if (aligned > mapped)
+        munmap(mapped, aligned - mapped);
+    if (aligned + bytes < mapped + mappedBytes)
+        munmap(aligned + bytes, mapped + mappedBytes - (aligned + bytes));
+    return aligned;
+}
+
+// Allocates a new zeroed buffer, exits if no memory is left
+static inline void newFieldBuffer(struct FieldBuffer *buffer)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t offset = 0;
+    buffer->allocated = NULL;
+    buffer->mapped = true;
+
+    switch (buffer->allocation)
+    {
+    case FIELD_ALLOCATION_HUGETLB:
+    case FIELD_ALLOCATION_HUGE:
+        if (buffer->size >= FIELD_HUGE_PAGE_SIZE)
+        {
+            offset = (fieldAllocator.hugeBuffers % 2) * FIELD_COLOR_OFFSET;
+            buffer->bytes = roundUpFieldBytes(buffer->size + offset, FIELD_HUGE_PAGE_SIZE);
+
+            if (buffer->allocation == FIELD_ALLOCATION_HUGETLB)
+                buffer->allocated = mapFieldMemory(buffer->bytes, FIELD_HUGE_PAGE_SIZE, MAP_HUGETLB);
+
+            // No reserved huge pages (see /proc/sys/vm/nr_hugepages), use transparent huge pages
+            if (buffer->allocated == NULL)
+            {
+                buffer->allocated = mapFieldMemory(buffer->bytes, FIELD_HUGE_PAGE_SIZE, 0);
+                if (buffer->allocated != NULL)
+                    madvise(buffer->allocated, buffer->bytes, MADV_HUGEPAGE);
+            }
+            fieldAllocator.hugeBuffers++;
+            break;
+        }
+        // Less than a huge page
+        // fall through
+    case FIELD_ALLOCATION_PAGE:
+        buffer->bytes = roundUpFieldBytes(buffer->size, pageSize);
+        buffer->allocated = mapFieldMemory(buffer->bytes, pageSize, 0);
+        break;
+    case FIELD_ALLOCATION_ALIGNED:
+        buffer->bytes = roundUpFieldBytes(buffer->size, FIELD_ALIGNMENT);
+        buffer->mapped = false;
+        if (posix_memalign(&buffer->allocated, FIELD_ALIGNMENT, buffer->bytes) == 0)
+            memset(buffer->allocated, 0, buffer->bytes);
+        else
+            buffer->allocated = NULL;
+        break;
+    case FIELD_ALLOCATION_CALLOC:
+        buffer->bytes = buffer->size;
+        buffer->mapped = false;
+        buffer->allocated = calloc(buffer->size, 1);
+        break;
+    }
+
+    if (buffer->allocated == NULL)
+    {
+        fprintf(stderr, "Could not allocate %zu bytes for a field\n", buffer->size);
+        exit(1);
+    }
+    buffer->memory = (char *)buffer->allocated + offset;
+}
+
+static inline void deleteFieldBuffer(struct FieldBuffer *buffer)
+{
+    if (buffer->mapped)
+        munmap(buffer->allocated, buffer->bytes);
+    else
+        free(buffer->allocated);
+    buffer->memory = NULL;
+}
+
+// Zeroed buffer of size bytes with the current allocation, taken from the pool if possible
+static inline void allocateFieldBuffer(struct FieldBuffer *buffer, size_t size)
+{
+    for (int i = fieldAllocator.pooled - 1; i >= 0; i--)
+    {
+        struct FieldBuffer *pooled = &fieldAllocator.pool[i];
+        if (pooled->size == size && pooled->allocation == fieldAllocator.allocation)
+        {
+            *buffer = *pooled;
+
+            // Keeps the pool ordered from the oldest to the newest buffer
+            memmove(pooled, pooled + 1, (fieldAllocator.pooled - 1 - i) * sizeof(struct FieldBuffer));
+            fieldAllocator.pooled--;
+            memset(buffer->memory, 0, buffer->size);
+            return;
+        }
+    }
+
+    buffer->size = size;
+    buffer->allocation = fieldAllocator.allocation;
+    newFieldBuffer(buffer);
+}
+
+// Returns the buffer to the pool, the oldest pooled buffer is released if the pool is full
+static inline void releaseFieldBuffer(struct FieldBuffer *buffer)
+{
+    if (buffer->memory == NULL)
+        return;
+
+    if (!fieldAllocator.pooling)
+    {
+        deleteFieldBuffer(buffer);
+        return;
+    }
+
+    if (fieldAllocator.pooled == FIELD_POOL_CAPACITY)
+    {
+        deleteFieldBuffer(&fieldAllocator.pool[0]);
+        memmove(&fieldAllocator.pool[0], &fieldAllocator.pool[1], (FIELD_POOL_CAPACITY - 1) * sizeof(struct FieldBuffer));
+        fieldAllocator.pooled--;
+    }
+    fieldAllocator.pool[fieldAllocator.pooled++] = *buffer;
+    buffer->memory = NULL;
+}
+
+// Releases the pooled buffers, called at the exit of the programs and by golReleaseMemory of the library
+static inline void clearFieldPool(void)
+{
+    while (fieldAllocator.pooled > 0)
+        deleteFieldBuffer(&fieldAllocator.pool[--fieldAllocator.pooled]);
+}
+
+#endif // GOL_ALLOC
@@ -0,0 +1,72 @@
+#ifndef GOL_CYCLE
+#define GOL_CYCLE
+
+#include "gol_field.h"
+
+//
+// Cycle Detection
+//
+// Keeps the board hashes (TRACK_HASH) of the last 2 * maxPeriod generations in a ring. A period p is reported once
+// the last p hashes repeat the p hashes before them, i.e. a whole period has been observed twice. This makes a
+// false positive through a single hash collision practically impossible.
+//
+
+struct CycleDetector
+{
+    int maxPeriod;
+    int capacity; // 2 * maxPeriod
+    uint64_t *hashes;
+
+    long generations; // number of recorded generations
+
+    long generation; // generation at which the cycle was detected (0 if none)
+    int period;      // detected period (0 if none)
+};
+
+static inline void initializeCycleDetector(struct CycleDetector *detector, int maxPeriod)
+{
+    detector->maxPeriod = maxPeriod;
+    detector->capacity = 2 * maxPeriod;
+    detector->hashes = (uint64_t *)calloc(detector->capacity, sizeof(uint64_t));
+    detector->generations = 0;
+    detector->generation = 0;
+    detector->period = 0;
+}
+
+static inline void freeCycleDetector(struct CycleDetector *detector)
+{
+    free(detector->hashes);
+}
+
+// Hash of the k-th most recent generation (k = 0 is the latest)
+static inline uint64_t cycleDetectorHash(struct CycleDetector *detector, int k)
+{
+    return detector->hashes[(detector->generations - 1 - k) % detector->capacity];
+}
+
+// Records the hash of the given generation, returns the smallest detected period or 0
+static inline int recordCycleDetector(struct CycleDetector *detector, long generation, uint64_t hash)
+{
+    detector->hashes[detector->generations % detector->capacity] = hash;
+    detector->generations++;
+
+    for (int period = 1; period <= detector->maxPeriod && 2 * period <= detector->generations; period++)
+    {
+        int k;
+        for (k = 0; k < period; k++)
+        {
+            if (cycleDetectorHash(detector, k) != cycleDetectorHash(detector, k + period))
+                break;
+        }
+
+        if (k == period)
+        {
+            detector->generation = generation;
+            detector->period = period;
+            return period;
+        }
+    }
+    return 0;
+}
+
+#endif // GOL_CYCLE
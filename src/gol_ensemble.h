@@ -0,0 +1,322 @@
+#ifndef GOL_ENSEMBLE
+#define GOL_ENSEMBLE
+
+#include <stdint.h>
+
+#include "gol_field.h"
+#include "gol_plain_utils.h"
+
+//
+// Ensemble
+//
+// Many independent boards of the same size are simulated together. The boards are bit sliced: every cell is one
+// 64 bit word and bit b of the word belongs to board b of the batch. One bitwise operation therefore advances the
+// same cell of 64 boards at once. Batches of 64 boards are independent and are distributed over the threads.
+//
+
+#define ENSEMBLE_LANES 64
+
+typedef uint64_t LaneType;
+
+struct Ensemble
+{
+    int count;
+    int width;
+    int height;
+    enum BoundaryMode boundary;
+
+    int batches; // count / ENSEMBLE_LANES rounded up
+    long generation; // generations simulated, next holds the previous generation once it is > 0
+
+    // batches * width * height words each, batch b starts at b * width * height
+    LaneType *current;
+    LaneType *next;
+};
+
+static inline void initializeEnsemble(struct Ensemble *ensemble, int count, int width, int height, enum BoundaryMode boundary)
+{
+    ensemble->count = count;
+    ensemble->width = width;
+    ensemble->height = height;
+    ensemble->boundary = boundary;
+    ensemble->batches = (count + ENSEMBLE_LANES - 1) / ENSEMBLE_LANES;
+    ensemble->generation = 0;
+
+    size_t words = (size_t)ensemble->batches * width * height;
+    ensemble->current = (LaneType *)calloc(words, sizeof(LaneType));
+    ensemble->next = (LaneType *)calloc(words, sizeof(LaneType));
+}
+
+static inline void freeEnsemble(struct Ensemble *ensemble)
+{
+    free(ensemble->current);
+    free(ensemble->next);
+}
+
+static inline LaneType *ensembleBatch(struct Ensemble *ensemble, LaneType *words, int batch)
+{
+    return words + (size_t)batch * ensemble->width * ensemble->height;
+}
+
+//
+// Conversion
+//
+
+static inline void ensembleSetBoard(struct Ensemble *ensemble, int board, struct Field *field)
+{
+    LaneType *words = ensembleBatch(ensemble, ensemble->current, board / ENSEMBLE_LANES);
+    LaneType bit = (LaneType)1 << (board % ENSEMBLE_LANES);
+    long cells = (long)ensemble->width * ensemble->height;
+
+    for (long i = 0; i < cells; i++)
+    {
+        words[i] = field->field[i] ? (words[i] | bit) : (words[i] & ~bit);
+    }
+}
+
+static inline void ensembleGetBoard(struct Ensemble *ensemble, int board, struct Field *field)
+{
+    LaneType *words = ensembleBatch(ensemble, ensemble->current, board / ENSEMBLE_LANES);
+    int lane = board % ENSEMBLE_LANES;
+    long cells = (long)ensemble->width * ensemble->height;
+
+    for (long i = 0; i < cells; i++)
+    {
+        field->field[i] = (words[i] >> lane) & 1;
+    }
+}
+
+// Fills one board with the random generator seeded by seed
+static inline void ensembleFillRandom(struct Ensemble *ensemble, int board, unsigned int seed, double density)
+{
+    struct Field field;
+    initializeField(&field, ensemble->width, ensemble->height, 1, 1);
+
+    srand(seed);
+    fillRandomDensity(&field, density);
+    ensembleSetBoard(ensemble, board, &field);
+
+    freeField(&field);
+}
+
+// Adds one to counts[lane] of every lane set in word
+static inline void ensembleCountLanes(LaneType word, long *counts)
+{
+    for (; word; word &= word - 1)
+        counts[__builtin_ctzll(word)]++;
+}
+
+// Sets last[lane] to position for every lane set in word, and first[lane] as well if the lane is not in seen yet
+static inline void ensembleExtendLanes(LaneType word, LaneType *seen, int position, int *first, int *last)
+{
+    for (LaneType lanes = word & ~*seen; lanes; lanes &= lanes - 1)
+        first[__builtin_ctzll(lanes)] = position;
+    for (LaneType lanes = word; lanes; lanes &= lanes - 1)
+        last[__builtin_ctzll(lanes)] = position;
+    *seen |= word;
+}
+
+// Population, births, deaths and bounding box of the current generation of every board (the hash is not computed),
+// statistics must hold ensemble->count entries. Births and deaths are -1 before the first generation.
+static inline void ensembleStatistics(struct Ensemble *ensemble, struct FieldStatistics *statistics)
+{
+    int width = ensemble->width;
+    int height = ensemble->height;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int batch = 0; batch < ensemble->batches; batch++)
+    {
+        long population[ENSEMBLE_LANES] = {0};
+        long births[ENSEMBLE_LANES] = {0};
+        long deaths[ENSEMBLE_LANES] = {0};
+        int minX[ENSEMBLE_LANES], minY[ENSEMBLE_LANES], maxX[ENSEMBLE_LANES], maxY[ENSEMBLE_LANES];
+        LaneType seenX = 0;
+        LaneType seenY = 0;
+
+        const LaneType *words = ensembleBatch(ensemble, ensemble->current, batch);
+        const LaneType *previous = ensembleBatch(ensemble, ensemble->next, batch);
+
+        // The bounding box only needs the lanes set in any cell of a column / row
+        LaneType *columns = (LaneType *)calloc(width, sizeof(LaneType));
+        for (int y = 0; y < height; y++)
+        {
+            const LaneType *row = words + calcIndex(width, 0, y);
+            const LaneType *previousRow = previous + calcIndex(width, 0, y);
+            LaneType lanes = 0;
+            for (int x = 0; x < width; x++)
+            {
+                ensembleCountLanes(row[x], population);
+                if (ensemble->generation > 0)
+                {
+                    ensembleCountLanes(row[x] & ~previousRow[x], births);
+                    ensembleCountLanes(~row[x] & previousRow[x], deaths);
+                }
+                columns[x] |= row[x];
+                lanes |= row[x];
+            }
+            ensembleExtendLanes(lanes, &seenY, y, minY, maxY);
+        }
+        for (int x = 0; x < width; x++)
+            ensembleExtendLanes(columns[x], &seenX, x, minX, maxX);
+        free(columns);
+
+        for (int lane = 0; lane < ENSEMBLE_LANES && batch * ENSEMBLE_LANES + lane < ensemble->count; lane++)
+        {
+            struct FieldStatistics *board = &statistics[batch * ENSEMBLE_LANES + lane];
+            initializeFieldStatistics(board);
+            board->population = population[lane];
+            board->births = ensemble->generation > 0 ? births[lane] : -1;
+            board->deaths = ensemble->generation > 0 ? deaths[lane] : -1;
+            if (seenX >> lane & 1)
+            {
+                board->minX = minX[lane];
+                board->minY = minY[lane];
+                board->maxX = maxX[lane];
+                board->maxY = maxY[lane];
+            }
+        }
+    }
+}
+
+//
+// Simulation
+//
+
+// Adds one bit per lane to the 3 bit per lane counter (b0, b1, b2), the count is only needed modulo 8
+#define ENSEMBLE_ADD(B0, B1, B2, N)          \
+    {                                        \
+        LaneType carry0 = (B0) & (N);        \
+        (B0) ^= (N);                         \
+        LaneType carry1 = (B1) & carry0;     \
+        (B1) ^= carry0;                      \
+        (B2) ^= carry1;                      \
+    }
+
+static inline LaneType ensembleRule(LaneType self, LaneType n0, LaneType n1, LaneType n2, LaneType n3,
+                                    LaneType n4, LaneType n5, LaneType n6, LaneType n7)
+{
+    LaneType b0 = 0, b1 = 0, b2 = 0;
+    ENSEMBLE_ADD(b0, b1, b2, n0)
+    ENSEMBLE_ADD(b0, b1, b2, n1)
+    ENSEMBLE_ADD(b0, b1, b2, n2)
+    ENSEMBLE_ADD(b0, b1, b2, n3)
+    ENSEMBLE_ADD(b0, b1, b2, n4)
+    ENSEMBLE_ADD(b0, b1, b2, n5)
+    ENSEMBLE_ADD(b0, b1, b2, n6)
+    ENSEMBLE_ADD(b0, b1, b2, n7)
+
+    // Either 3 neighbors or 2 neighbors and alive (8 neighbors wrap to 0 and die as well)
+    return b1 & ~b2 & (b0 | self);
+}
+
+#undef ENSEMBLE_ADD
+
+static inline LaneType ensembleWord(const LaneType *row, int x, int width, enum BoundaryMode boundary)
+{
+    int bx = boundaryCoordinate(x, width, boundary);
+    return (row == NULL || bx < 0) ? 0 : row[bx];
+}
+
+// Computes row y of one batch
+static inline void ensembleStepRow(struct Ensemble *ensemble, const LaneType *current, LaneType *next, int y)
+{
+    int width = ensemble->width;
+    enum BoundaryMode boundary = ensemble->boundary;
+
+    int yAbove = boundaryCoordinate(y - 1, ensemble->height, boundary);
+    int yBelow = boundaryCoordinate(y + 1, ensemble->height, boundary);
+    const LaneType *above = yAbove < 0 ? NULL : current + calcIndex(width, 0, yAbove);
+    const LaneType *row = current + calcIndex(width, 0, y);
+    const LaneType *below = yBelow < 0 ? NULL : current + calcIndex(width, 0, yBelow);
+    LaneType *out = next + calcIndex(width, 0, y);
+
+    if (above != NULL && below != NULL)
+    {
+        // Interior without boundary checks
+        for (int x = 1; x < width - 1; x++)
+        {
+            out[x] = ensembleRule(row[x],
+                                  above[x - 1], above[x], above[x + 1],
+                                  row[x - 1], row[x + 1],
+                                  below[x - 1], below[x], below[x + 1]);
+        }
+    }
+    else
+    {
+        for (int x = 1; x < width - 1; x++)
+        {
+            out[x] = ensembleRule(row[x],
+                                  ensembleWord(above, x - 1, width, boundary), ensembleWord(above, x, width, boundary),
+                                  ensembleWord(above, x + 1, width, boundary),
+                                  row[x - 1], row[x + 1],
+                                  ensembleWord(below, x - 1, width, boundary), ensembleWord(below, x, width, boundary),
+                                  ensembleWord(below, x + 1, width, boundary));
+        }
+    }
+
+    // Border columns
+    for (int x = 0; x < width; x += MAX(width - 1, 1))
+    {
+        out[x] = ensembleRule(row[x],
+                              ensembleWord(above, x - 1, width, boundary), ensembleWord(above, x, width, boundary),
+                              ensembleWord(above, x + 1, width, boundary),
+                              ensembleWord(row, x - 1, width, boundary), ensembleWord(row, x + 1, width, boundary),
+                              ensembleWord(below, x - 1, width, boundary), ensembleWord(below, x, width, boundary),
+                              ensembleWord(below, x + 1, width, boundary));
+    }
+}
+
+static inline void simulateEnsemble(struct Ensemble *ensemble, int timesteps)
+{
+    if (ensemble->batches >= omp_get_max_threads())
+    {
+        // Enough batches: every thread advances whole batches through all timesteps without synchronization
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int batch = 0; batch < ensemble->batches; batch++)
+        {
+            LaneType *current = ensembleBatch(ensemble, ensemble->current, batch);
+            LaneType *next = ensembleBatch(ensemble, ensemble->next, batch);
+            for (int t = 0; t < timesteps; t++)
+            {
+                for (int y = 0; y < ensemble->height; y++)
+                    ensembleStepRow(ensemble, current, next, y);
+
+                LaneType *temp = current;
+                current = next;
+                next = temp;
+            }
+        }
+
+        // Every batch ran the same number of timesteps
+        if (timesteps % 2 == 1)
+        {
+            LaneType *temp = ensemble->current;
+            ensemble->current = ensemble->next;
+            ensemble->next = temp;
+        }
+    }
+    else
+    {
+        // Few batches: additionally split the rows of every batch
+        for (int t = 0; t < timesteps; t++)
+        {
+            #pragma omp parallel for collapse(2)
+            for (int batch = 0; batch < ensemble->batches; batch++)
+            {
+                for (int y = 0; y < ensemble->height; y++)
+                {
+                    ensembleStepRow(ensemble, ensembleBatch(ensemble, ensemble->current, batch),
+                                    ensembleBatch(ensemble, ensemble->next, batch), y);
+                }
+            }
+
+            LaneType *temp = ensemble->current;
+            ensemble->current = ensemble->next;
+            ensemble->next = temp;
+        }
+    }
+
+    ensemble->generation += timesteps;
+}
+
+#endif // GOL_ENSEMBLE
@@ -9,9 +9,13 @@
 
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
 #include <math.h>
 #include <sys/time.h>
 
+#include "gol_alloc.h"
+
 #define calcIndex(width, x, y) ((y) * (width) + (x))
 #define MAX(a, b) ((a) > (b) ? a : b)
 #define MIN(a, b) ((a) < (b) ? a : b)
@@ -19,38 +23,76 @@
 #define DEBUG
 #undef DEBUG
 
-#define VTK_OUTPUT
-#undef VTK_OUTPUT
+//
+// Field & Initialization
+//
 
-#ifdef VTK_OUTPUT
+typedef char FieldType;
 
-#define VTK_INIT \
-    char pathPrefix[1024]; \
-    snprintf(pathPrefix, sizeof(pathPrefix), "output/"); 
+// Boundary condition applied to neighbors outside of the field
+enum BoundaryMode
+{
+    BOUNDARY_TORUS,   // wrap around to the opposite side
+    BOUNDARY_DEAD,    // cells outside the field are always dead
+    BOUNDARY_REFLECT, // cells outside the field mirror the cells inside (-1 -> 0, width -> width - 1)
+};
 
-#define VTK_OUTPUT_SEGMENT(TIMESTEP, START_X, END_X, START_Y, END_Y) \
-    char prefix[1024]; \
-    snprintf(prefix, sizeof(prefix), "gol_mtp_%05d", TIMESTEP); \
-    writeVTK2(currentField, pathPrefix, prefix, START_X, END_X, START_Y, END_Y); \
+// Statistics the engines compute while writing newField, selected by Field.tracking
+#define TRACK_HASH 0x1       // position dependent hash of the board (only comparable within one run / segmentation)
+#define TRACK_STATISTICS 0x2 // population, births, deaths and bounding box
+#define TRACK_DENSITY 0x4    // live cells of every 4 x 4 block into Field.densities (level 0 of the density pyramid)
 
-#define VTK_OUTPUT_MASTER(TIMESTEP) \
-    char masterPrefix[1024]; \
-    snprintf(masterPrefix, sizeof(masterPrefix), "gol_mtp_%05d", TIMESTEP); \
-    writeVTK2Master(currentField, pathPrefix, masterPrefix);
+#define DENSITY_BLOCK 4 // cells per side of the TRACK_DENSITY blocks
 
-#else
+struct FieldStatistics
+{
+    uint64_t hash;
 
-#define VTK_INIT
-#define VTK_OUTPUT_SEGMENT(TIMESTEP, START_X, END_X, START_Y, END_Y)
-#define VTK_OUTPUT_MASTER(TIMESTEP)
+    long population;
+    long births;
+    long deaths;
 
-#endif // VTK_OUTPUT
+    // Bounding box of the live cells (inclusive), minX > maxX if there are none
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
 
-//
-// Field & Initialization
-//
+static inline void initializeFieldStatistics(struct FieldStatistics *statistics)
+{
+    memset(statistics, 0, sizeof(*statistics));
+    statistics->minX = INT_MAX;
+    statistics->minY = INT_MAX;
+    statistics->maxX = -1;
+    statistics->maxY = -1;
+}
+
+static inline void mergeFieldStatistics(struct FieldStatistics *out, struct FieldStatistics *in)
+{
+    out->hash += in->hash;
+    out->population += in->population;
+    out->births += in->births;
+    out->deaths += in->deaths;
+    out->minX = MIN(out->minX, in->minX);
+    out->minY = MIN(out->minY, in->minY);
+    out->maxX = MAX(out->maxX, in->maxX);
+    out->maxY = MAX(out->maxY, in->maxY);
+}
+
+// Adds a live cell to the bounding box
+static inline void extendFieldStatistics(struct FieldStatistics *statistics, int x, int y)
+{
+    statistics->minX = MIN(statistics->minX, x);
+    statistics->minY = MIN(statistics->minY, y);
+    statistics->maxX = MAX(statistics->maxX, x);
+    statistics->maxY = MAX(statistics->maxY, y);
+}
+
+// Per thread statistics are reduced by OpenMP without atomics: reduction(mergeStatistics : statistics)
+#pragma omp declare reduction(mergeStatistics : struct FieldStatistics : mergeFieldStatistics(&omp_out, &omp_in)) \
+    initializer(initializeFieldStatistics(&omp_priv))
 
-typedef char FieldType;
 struct Field
 {
     int width;
@@ -61,7 +103,14 @@ struct Field
     double factorX;
     double factorY;
 
+    enum BoundaryMode boundary;
+
+    unsigned int tracking;             // TRACK_* flags, engines fill newField->statistics if set
+    struct FieldStatistics statistics; // statistics of the generation stored in field
+    uint32_t *densities;               // TRACK_DENSITY block sums of the generation stored in field
+
     FieldType *field;
+    struct FieldBuffer buffer; // memory of field, see gol_alloc.h
 };
 
 // current_field, new_field, x, y
@@ -110,7 +159,13 @@ static inline void initializeField(struct Field *field, int width, int height, i
     field->factorX = field->width / (double)field->segmentsX;
     field->factorY = field->height / (double)field->segmentsY;
 
-    field->field = (FieldType *)calloc(width * height, sizeof(FieldType));
+    field->boundary = BOUNDARY_TORUS;
+    field->tracking = 0;
+    initializeFieldStatistics(&field->statistics);
+    field->densities = NULL;
+
+    allocateFieldBuffer(&field->buffer, (size_t)width * height * sizeof(FieldType));
+    field->field = (FieldType *)field->buffer.memory;
 }
 
 static inline void initializeFieldOther(struct Field *field, struct Field *other)
@@ -121,8 +176,35 @@ static inline void initializeFieldOther(struct Field *field, struct Field *other
     field->segmentsY = other->segmentsY;
     field->factorX = other->factorX;
     field->factorY = other->factorY;
+    field->boundary = other->boundary;
+    field->tracking = other->tracking;
+    initializeFieldStatistics(&field->statistics);
+    field->densities = NULL;
+
+    allocateFieldBuffer(&field->buffer, (size_t)other->width * other->height * sizeof(FieldType));
+    field->field = (FieldType *)field->buffer.memory;
+}
 
-    field->field = (FieldType *)calloc(other->width * other->height, sizeof(FieldType));
+// Returns the memory of the field to the pool of the allocator
+static inline void freeField(struct Field *field)
+{
+    releaseFieldBuffer(&field->buffer);
+    field->field = NULL;
+    free(field->densities);
+    field->densities = NULL;
+}
+
+// Block rows / columns of the TRACK_DENSITY blocks, partial blocks at the right and bottom border included
+static inline int densityBlocks(int size)
+{
+    return (size + DENSITY_BLOCK - 1) / DENSITY_BLOCK;
+}
+
+// Memory for the TRACK_DENSITY block sums, kept until freeField
+static inline void allocateFieldDensities(struct Field *field)
+{
+    if (field->densities == NULL)
+        field->densities = (uint32_t *)malloc((size_t)densityBlocks(field->width) * densityBlocks(field->height) * sizeof(uint32_t));
 }
 
 void initializeFields(struct Field *currentField, struct Field *newField, int width, int height, int segmentsX, int segmentsY)
@@ -131,6 +213,104 @@ void initializeFields(struct Field *currentField, struct Field *newField, int wi
     initializeFieldOther(newField, currentField);
 }
 
+static inline void setBoundaryMode(struct Field *currentField, struct Field *newField, enum BoundaryMode boundary)
+{
+    currentField->boundary = boundary;
+    newField->boundary = boundary;
+}
+
+// Returns -1 if the name is unknown
+static inline int parseBoundaryMode(const char *name)
+{
+    if (strcmp(name, "torus") == 0)
+        return BOUNDARY_TORUS;
+    if (strcmp(name, "dead") == 0)
+        return BOUNDARY_DEAD;
+    if (strcmp(name, "reflect") == 0)
+        return BOUNDARY_REFLECT;
+    return -1;
+}
+
+//
+// Hashing
+//
+
+// splitmix64 finalizer
+static inline uint64_t hashMix(uint64_t value)
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+// Hashes count cells starting at the cell index position, 8 cells per mix. Hashes of disjoint ranges are summed.
+static inline uint64_t hashCells(const FieldType *cells, int count, uint64_t position)
+{
+    uint64_t hash = 0;
+    int i = 0;
+
+    // Whole words with a constant size load, the loop is vectorized
+    for (; i + 8 <= count; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, cells + i, 8);
+        hash += hashMix(word ^ ((position + i) * 0x9e3779b97f4a7c15ULL));
+    }
+
+    if (i < count)
+    {
+        uint64_t word = 0;
+        memcpy(&word, cells + i, (count - i) * sizeof(FieldType));
+        hash += hashMix(word ^ ((position + i) * 0x9e3779b97f4a7c15ULL));
+    }
+    return hash;
+}
+
+// Population and bounding box of a field in a separate pass (births and deaths are unknown), e.g. for the initial board
+static inline void computeFieldStatistics(struct Field *currentField, struct FieldStatistics *result)
+{
+    struct FieldStatistics statistics;
+    initializeFieldStatistics(&statistics);
+
+    #pragma omp parallel for reduction(mergeStatistics : statistics)
+    for (int y = 0; y < currentField->height; y++)
+    {
+        const FieldType *row = currentField->field + calcIndex(currentField->width, 0, y);
+        for (int x = 0; x < currentField->width; x++)
+        {
+            if (row[x])
+            {
+                statistics.population++;
+                extendFieldStatistics(&statistics, x, y);
+            }
+        }
+    }
+
+    *result = statistics;
+}
+
+static inline void fillRandomDensity(struct Field *currentField, double density)
+{
+    int i;
+    for (i = 0; i < currentField->width * currentField->height; i++)
+    {
+        currentField->field[i] = (rand() < RAND_MAX * density) ? 1 : 0;
+    }
+}
+
+// Every period-th row alive, the rest dead. Full rows fill every lane of the vectorized statistics counters.
+static inline void fillRowStripes(struct Field *currentField, int period)
+{
+    for (int y = 0; y < currentField->height; y++)
+    {
+        memset(currentField->field + calcIndex(currentField->width, 0, y), y % period == 0 ? 1 : 0,
+               currentField->width * sizeof(FieldType));
+    }
+}
+
 static inline void fillRandom(struct Field *currentField)
 {
     int i;
@@ -140,6 +320,19 @@ static inline void fillRandom(struct Field *currentField)
     }
 }
 
+static inline long countPopulation(struct Field *currentField)
+{
+    long population = 0;
+    long cells = (long)currentField->width * currentField->height;
+
+    #pragma omp parallel for reduction(+ : population)
+    for (long i = 0; i < cells; i++)
+    {
+        population += currentField->field[i];
+    }
+    return population;
+}
+
 //
 // (VTK) Helper
 //
@@ -150,7 +343,7 @@ void writeVTK2(struct Field *data, char pathPrefix[1024], char prefix[1024], int
     int x, y;
 
     float deltax = 1.0;
-    long nxy = data->width * data->height * sizeof(float);
+    long nxy = (long)(endX - startX) * (endY - startY) * sizeof(float);
 
     int ret = snprintf(filename, sizeof(filename), "%s%s_%d_%d.vti", pathPrefix, prefix, startX, startY);
     if (ret < 0) {
@@ -172,14 +365,17 @@ void writeVTK2(struct Field *data, char pathPrefix[1024], char prefix[1024], int
     fprintf(fp, "_");
     fwrite((unsigned char *)&nxy, sizeof(long), 1, fp);
 
+    // Converted and written row wise
+    float *values = (float *)malloc(MAX(endX - startX, 1) * sizeof(float));
     for (y = startY; y < endY; y++)
     {
         for (x = startX; x < endX; x++)
         {
-            float value = (float)data->field[calcIndex(data->width, x, y)];
-            fwrite((unsigned char *)&value, sizeof(float), 1, fp);
+            values[x - startX] = (float)data->field[calcIndex(data->width, x, y)];
         }
+        fwrite((unsigned char *)values, sizeof(float), endX - startX, fp);
     }
+    free(values);
 
     fprintf(fp, "\n</AppendedData>\n");
     fprintf(fp, "</VTKFile>\n");
@@ -227,18 +423,30 @@ void writeVTK2Master(struct Field *data, char pathPrefix[1024], char prefix[1024
 
 
 
+// Full redraw of a small board (2 characters per cell) in one write, see gol_render.h for large boards
 void printField(struct Field *currentField)
 {
-    printf("\033[H");
-    int x, y;
-    for (y = 0; y < currentField->height; y++)
+    // "\033[07m  \033[m" per live cell and a newline per row
+    size_t capacity = (size_t)currentField->height * (currentField->width * 9 + 1) + 4;
+    char *buffer = (char *)malloc(capacity);
+    char *out = buffer;
+
+    out += sprintf(out, "\033[H");
+    for (int y = 0; y < currentField->height; y++)
     {
-        for (x = 0; x < currentField->width; x++)
-            printf(currentField->field[calcIndex(currentField->width, x, y)] ? "\033[07m  \033[m" : "  ");
-        //printf("\033[E");
-        printf("\n");
+        for (int x = 0; x < currentField->width; x++)
+        {
+            const char *cell = currentField->field[calcIndex(currentField->width, x, y)] ? "\033[07m  \033[m" : "  ";
+            size_t length = strlen(cell);
+            memcpy(out, cell, length);
+            out += length;
+        }
+        *out++ = '\n';
     }
+
+    fwrite(buffer, 1, out - buffer, stdout);
     fflush(stdout);
+    free(buffer);
 }
 
 #endif // GOL_FIELD
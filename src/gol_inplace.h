@@ -0,0 +1,95 @@
+#ifndef GOL_INPLACE
+#define GOL_INPLACE
+
+#include "gol_field.h"
+#include "gol_plain_utils.h"
+#include "gol_affinity.h"
+
+//
+// In-Place Engine
+//
+// Updates a single field instead of writing a second one, which halves the memory of a board (and the DRAM traffic
+// of the stores). Every thread owns a horizontal strip of rows and walks it top down. Before a row is overwritten it
+// is copied into a rolling buffer, so the row below still sees the original row above it. The original rows at the
+// strip seams (the row above and below every strip, owned by the neighboring strips) are saved by all threads before
+// any row is written. Scratch memory is 4 rows per thread.
+//
+// The engine matches simulate_func with newField == currentField, e.g. simulateSteps(n, &field, &field, ...),
+// the swap of simulateSteps is a no-op then.
+//
+
+// Copies the original row y (mapped by the boundary mode) into saved, a zero row if it is outside of a dead boundary
+static inline void saveSeamRow(struct Field *field, int y, FieldType *saved)
+{
+    int by = boundaryCoordinate(y, field->height, field->boundary);
+    if (by < 0)
+        memset(saved, 0, field->width * sizeof(FieldType));
+    else
+        memcpy(saved, field->field + calcIndex(field->width, 0, by), field->width * sizeof(FieldType));
+}
+
+static inline void simulateStepInPlace(struct Field *currentField, struct Field *newField, int timestep)
+{
+    struct Field *field = currentField;
+    int width = field->width;
+    int height = field->height;
+    unsigned int tracking = field->tracking;
+
+    // seam above, seam below and two rolling rows per thread
+    int maxThreads = omp_get_max_threads();
+    FieldType *scratch = (FieldType *)malloc((size_t)4 * maxThreads * width * sizeof(FieldType));
+
+    struct FieldStatistics statistics;
+    initializeFieldStatistics(&statistics);
+
+    #pragma omp parallel reduction(mergeStatistics : statistics)
+    {
+        // Strips in topology order, neighboring strips share their seams on neighboring cores (see gol_affinity.h)
+        int threads = omp_get_num_threads();
+        int rank = segmentRank();
+        int startY = (long)height * rank / threads;
+        int endY = (long)height * (rank + 1) / threads;
+
+        FieldType *seamAbove = scratch + (size_t)4 * omp_get_thread_num() * width;
+        FieldType *seamBelow = seamAbove + width;
+        FieldType *rolling[2] = {seamBelow + width, seamBelow + 2 * width};
+
+        if (startY < endY)
+        {
+            saveSeamRow(field, startY - 1, seamAbove);
+            saveSeamRow(field, endY, seamBelow);
+        }
+
+        // No row is written before all seams are saved
+        #pragma omp barrier
+
+        const FieldType *above = seamAbove;
+        for (int y = startY; y < endY; y++)
+        {
+            FieldType *out = field->field + calcIndex(width, 0, y);
+            FieldType *row = rolling[y & 1];
+            memcpy(row, out, width * sizeof(FieldType));
+            const FieldType *below = y + 1 < endY ? out + width : seamBelow;
+
+            golKernelRows(above, row, below, out, width, field->boundary);
+            if (tracking)
+                trackCells(row, out, 0, width, y, width, tracking, &statistics);
+            if (tracking & TRACK_DENSITY)
+                trackDensityRow(field, 0, width, startY, endY, y);
+
+            above = row;
+        }
+
+        // The density blocks across the strip seams need the rows of the neighboring strips
+        if (tracking & TRACK_DENSITY)
+        {
+            #pragma omp barrier
+            completeDensityBlocks(field, 0, width, startY, endY, 0, width, startY, endY);
+        }
+    }
+
+    free(scratch);
+    newField->statistics = statistics;
+}
+
+#endif // GOL_INPLACE
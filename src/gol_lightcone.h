@@ -0,0 +1,174 @@
+#ifndef GOL_LIGHTCONE
+#define GOL_LIGHTCONE
+
+#include "gol_field.h"
+#include "gol_inplace.h"
+
+//
+// Light Cone Viewport
+//
+// Computes a width x height window of generation T without advancing the whole board. Cell (x, y) of generation T
+// only depends on the cells within distance T of generation 0, so the window grown by T in every direction (the
+// backward light cone) is copied out of the field and simulated on its own. Every generation the valid region shrinks
+// by one cell on every side until only the window is left: generation t computes the window grown by T - t.
+//
+// Coordinates outside of the field follow the boundary mode at any distance: the torus repeats the field, reflect
+// mirrors it (period 2 * size, the mirrored board evolves symmetrically) and dead cells are cleared every generation.
+// Every generation is split into LIGHTCONE_TILE x LIGHTCONE_TILE tiles computed by the OpenMP threads.
+//
+// The cone costs sum (width + 2t) * (height + 2t) for t < T cell updates. If that is not below T full boards (large
+// windows or T in the order of the board size), the board is copied and advanced with the in-place engine instead.
+//
+
+#define LIGHTCONE_TILE 64
+
+// Maps a coordinate at any distance onto the field, -1 if the cell is dead
+static inline int coneCoordinate(int c, int size, enum BoundaryMode boundary)
+{
+    if (c >= 0 && c < size)
+        return c;
+
+    switch (boundary)
+    {
+    case BOUNDARY_TORUS:
+        return (c % size + size) % size;
+    case BOUNDARY_REFLECT:
+    {
+        int m = (c % (2 * size) + 2 * size) % (2 * size);
+        return m < size ? m : 2 * size - m - 1;
+    }
+    default:
+        return -1;
+    }
+}
+
+// Cell updates of the cone of a width x height window at generation T
+static inline double lightConeWork(int width, int height, int generations)
+{
+    double work = 0;
+    for (int t = 1; t <= generations; t++)
+    {
+        work += (double)(width + 2 * (generations - t)) * (height + 2 * (generations - t));
+    }
+    return work;
+}
+
+// Copies the window at (x, y) of field into window (row major, width * height cells)
+static inline void copyWindow(struct Field *field, int x, int y, int width, int height, FieldType *window)
+{
+    for (int wy = 0; wy < height; wy++)
+    {
+        int by = coneCoordinate(y + wy, field->height, field->boundary);
+        for (int wx = 0; wx < width; wx++)
+        {
+            int bx = coneCoordinate(x + wx, field->width, field->boundary);
+            window[calcIndex(width, wx, wy)] = bx >= 0 && by >= 0 ? field->field[calcIndex(field->width, bx, by)] : 0;
+        }
+    }
+}
+
+// Fallback for cones larger than the board: advance a copy of the whole board
+static inline void computeViewportFull(struct Field *field, int x, int y, int width, int height, int generations, FieldType *window)
+{
+    struct Field copy;
+    initializeFieldOther(&copy, field);
+    copy.tracking = 0;
+    memcpy(copy.field, field->field, (size_t)field->width * field->height * sizeof(FieldType));
+
+    for (int t = 0; t < generations; t++)
+    {
+        simulateStepInPlace(&copy, &copy, t);
+    }
+
+    copyWindow(&copy, x, y, width, height, window);
+    freeField(&copy);
+}
+
+// Writes the width x height window at (x, y) of the generation generations after field into window (row major).
+// The window may reach over the edges of the field, the cells there follow the boundary mode. field is not changed.
+static inline void computeViewport(struct Field *field, int x, int y, int width, int height, int generations, FieldType *window)
+{
+    if (generations <= 0 || lightConeWork(width, height, generations) >= (double)generations * field->width * field->height)
+    {
+        if (generations <= 0)
+            copyWindow(field, x, y, width, height, window);
+        else
+            computeViewportFull(field, x, y, width, height, generations, window);
+        return;
+    }
+
+    // Generation 0 of the cone, local (0, 0) is (x - T, y - T) of the board
+    int coneWidth = width + 2 * generations;
+    int coneHeight = height + 2 * generations;
+    size_t coneCells = (size_t)coneWidth * coneHeight;
+    FieldType *cone[2];
+    cone[0] = (FieldType *)malloc(coneCells * sizeof(FieldType));
+    cone[1] = (FieldType *)malloc(coneCells * sizeof(FieldType));
+    copyWindow(field, x - generations, y - generations, coneWidth, coneHeight, cone[0]);
+
+    // 1 if the local row / column is a cell of the field, cells outside of a dead boundary stay dead
+    FieldType *insideX = (FieldType *)malloc(coneWidth * sizeof(FieldType));
+    FieldType *insideY = (FieldType *)malloc(coneHeight * sizeof(FieldType));
+    for (int lx = 0; lx < coneWidth; lx++)
+        insideX[lx] = coneCoordinate(x - generations + lx, field->width, field->boundary) >= 0;
+    for (int ly = 0; ly < coneHeight; ly++)
+        insideY[ly] = coneCoordinate(y - generations + ly, field->height, field->boundary) >= 0;
+
+    #pragma omp parallel
+    {
+        for (int t = 1; t <= generations; t++)
+        {
+            const FieldType *current = cone[(t - 1) & 1];
+            FieldType *next = cone[t & 1];
+
+            // Region of generation t: the window grown by T - t
+            int margin = generations - t;
+            int startX = generations - margin;
+            int startY = generations - margin;
+            int regionWidth = width + 2 * margin;
+            int regionHeight = height + 2 * margin;
+            int tilesX = (regionWidth + LIGHTCONE_TILE - 1) / LIGHTCONE_TILE;
+            int tilesY = (regionHeight + LIGHTCONE_TILE - 1) / LIGHTCONE_TILE;
+
+            // Implicit barrier at the end, generation t + 1 reads the whole region
+            #pragma omp for schedule(static)
+            for (int tile = 0; tile < tilesX * tilesY; tile++)
+            {
+                int tileX = startX + tile % tilesX * LIGHTCONE_TILE;
+                int tileY = startY + tile / tilesX * LIGHTCONE_TILE;
+                int endX = MIN(tileX + LIGHTCONE_TILE, startX + regionWidth);
+                int endY = MIN(tileY + LIGHTCONE_TILE, startY + regionHeight);
+
+                for (int ly = tileY; ly < endY; ly++)
+                {
+                    const FieldType *above = current + calcIndex(coneWidth, 0, ly - 1);
+                    const FieldType *row = above + coneWidth;
+                    const FieldType *below = row + coneWidth;
+                    FieldType *out = next + calcIndex(coneWidth, 0, ly);
+
+                    for (int lx = tileX; lx < endX; lx++)
+                    {
+                        FieldType n = above[lx - 1] + above[lx] + above[lx + 1] +
+                                row[lx - 1] + row[lx + 1] +
+                                below[lx - 1] + below[lx] + below[lx + 1];
+
+                        out[lx] = ((n == 3) | ((n == 2) & row[lx])) & insideX[lx] & insideY[ly];
+                    }
+                }
+            }
+        }
+    }
+
+    const FieldType *result = cone[generations & 1];
+    for (int wy = 0; wy < height; wy++)
+    {
+        memcpy(window + calcIndex(width, 0, wy), result + calcIndex(coneWidth, generations, generations + wy), width * sizeof(FieldType));
+    }
+
+    free(insideY);
+    free(insideX);
+    free(cone[1]);
+    free(cone[0]);
+}
+
+#endif // GOL_LIGHTCONE
@@ -3,10 +3,760 @@
 
 #include "gol_field.h"
 #include "gol_plain_utils.h"
+#include "gol_affinity.h"
 
-static inline void simulateStepMPIPlain(struct Field *currentField, struct Field *newField, int timestep)
+// Only available when compiled with mpicc and -D USE_MPI (see Makefile target build-gol-mpi)
+#ifdef USE_MPI
+
+#include <mpi.h>
+#include <sched.h>
+
+//
+// Distributed Field
+//
+// The board is split into horizontal stripes of full rows, one per rank. Every rank keeps haloDepth ghost rows
+// above and below its own rows. After one exchange of haloDepth rows the rank can compute haloDepth generations
+// on a shrinking valid region before it has to communicate again.
+//
+// The stripes start with the same number of rows. With a rebalance interval the ranks compare their compute time
+// every interval generations and move the stripe borders so that every rank gets the same share of the measured cost
+// (weighted stripes, see rebalanceFieldMPI).
+//
+// With shared halos, ranks on the same node (MPI_COMM_TYPE_SHARED) keep their stripes in an MPI-3 shared memory
+// window. The first and last owned rows are computed from the boundary rows of the neighbors in the window, nothing is
+// copied, and a generation counter per rank replaces the exchange with them. Only neighbors on other nodes exchange
+// messages (see enableSharedHalosMPI).
+//
+
+struct FieldMPI
+{
+    MPI_Comm comm;
+    int rank;
+    int size;
+    int up;   // rank owning the rows above (MPI_PROC_NULL at a non torus border)
+    int down; // rank owning the rows below (MPI_PROC_NULL at a non torus border)
+
+    // Neighbors the halos are exchanged with as messages, MPI_PROC_NULL if there is none or it is on the same node
+    int messageUp;
+    int messageDown;
+
+    int globalWidth;
+    int globalHeight;
+    enum BoundaryMode boundary;
+
+    int startY; // first global row owned by this rank
+    int rows;   // number of rows owned by this rank
+
+    int haloDepth;
+    int validDepth; // ghost rows still valid for the next generation, 0 forces an exchange
+
+    // Local stripes: rows + 2 * haloDepth rows, owned row r is stored at local row haloDepth + r
+    struct Field *currentField;
+    struct Field *newField;
+    struct Field fields[2];
+
+    int rebalanceInterval; // generations between two load balancing checks, 0 disables them
+    bool rebalanceAlways;  // migrate whenever the weighted stripes differ, regardless of the predicted gain (testing)
+
+    // Shared halos: fields[0] and fields[1] live in window, the neighbors' stripes are read through it
+    bool sharedHalos;
+    MPI_Comm nodeComm; // ranks on the same node (or group of nodeSize ranks, see enableSharedHalosMPI)
+    MPI_Win window;
+    int nodeUp;   // rank of up in nodeComm, -1 if it exchanges messages
+    int nodeDown; // rank of down in nodeComm, -1 if it exchanges messages
+
+    // Last owned row of up / first owned row of down, in the neighbor's fields[0] / fields[1]
+    const FieldType *sharedRows[2][2];
+
+    // Generation counters of the ranks in a second shared window: the generation in the rank's currentField
+    long generation;
+    MPI_Win counterWindow;
+    long *publishedGeneration;
+    const long *sharedGenerations[2]; // counters of up / down, NULL if they exchange messages
+
+    // Statistics
+    long exchanges;
+    long messages;
+    long bytesSent;
+    long bytesShared; // boundary row bytes read from the window of a neighbor
+    double exchangeTime;
+    double computeTime;
+
+    double balancedComputeTime; // computeTime at the last load balancing check
+    long rebalances;            // applied repartitionings
+    long migratedBytes;         // received from other ranks over all repartitionings
+};
+
+static inline void initializeFieldMPI(struct FieldMPI *field, MPI_Comm comm, int width, int height, enum BoundaryMode boundary, int haloDepth)
+{
+    int periods = boundary == BOUNDARY_TORUS;
+    MPI_Comm_size(comm, &field->size);
+    MPI_Cart_create(comm, 1, &field->size, &periods, 0, &field->comm);
+    MPI_Comm_rank(field->comm, &field->rank);
+    MPI_Cart_shift(field->comm, 0, 1, &field->up, &field->down);
+    field->messageUp = field->up;
+    field->messageDown = field->down;
+
+    field->globalWidth = width;
+    field->globalHeight = height;
+    field->boundary = boundary;
+
+    int rowsPerRank = height / field->size;
+    int remainder = height % field->size;
+    field->rows = rowsPerRank + (field->rank < remainder);
+    field->startY = field->rank * rowsPerRank + MIN(field->rank, remainder);
+
+    if (rowsPerRank == 0)
+    {
+        if (field->rank == 0)
+            fprintf(stderr, "More ranks (%d) than rows (%d)\n", field->size, height);
+        MPI_Abort(comm, 1);
+    }
+
+    // Ghost rows are only received from the direct neighbors, deeper halos are not possible
+    field->haloDepth = MAX(1, MIN(haloDepth, rowsPerRank));
+    field->validDepth = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        initializeField(&field->fields[i], width, field->rows + 2 * field->haloDepth, 1, 1);
+        field->fields[i].boundary = boundary;
+    }
+    field->currentField = &field->fields[0];
+    field->newField = &field->fields[1];
+
+    field->rebalanceInterval = 0;
+    field->rebalanceAlways = false;
+
+    field->sharedHalos = false;
+    field->nodeComm = MPI_COMM_NULL;
+    field->window = MPI_WIN_NULL;
+    field->nodeUp = -1;
+    field->nodeDown = -1;
+    field->generation = 0;
+    field->counterWindow = MPI_WIN_NULL;
+    field->sharedGenerations[0] = NULL;
+    field->sharedGenerations[1] = NULL;
+
+    field->exchanges = 0;
+    field->messages = 0;
+    field->bytesSent = 0;
+    field->bytesShared = 0;
+    field->exchangeTime = 0;
+    field->computeTime = 0;
+
+    field->balancedComputeTime = 0;
+    field->rebalances = 0;
+    field->migratedBytes = 0;
+}
+
+static inline void freeFieldMPI(struct FieldMPI *field)
+{
+    freeField(&field->fields[0]);
+    freeField(&field->fields[1]);
+    if (field->window != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(field->window);
+        MPI_Win_free(&field->window);
+    }
+    if (field->counterWindow != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(field->counterWindow);
+        MPI_Win_free(&field->counterWindow);
+    }
+    if (field->nodeComm != MPI_COMM_NULL)
+        MPI_Comm_free(&field->nodeComm);
+    MPI_Comm_free(&field->comm);
+}
+
+static inline FieldType *localRowMPI(struct Field *local, int haloDepth, int row)
+{
+    return local->field + calcIndex(local->width, 0, haloDepth + row);
+}
+
+//
+// Shared Halos
+//
+
+// Last (bottom) or first owned row of the stripe of the node rank in the window, for both fields
+static inline void sharedNeighborRowsMPI(struct FieldMPI *field, int nodeRank, int rows, bool bottom, const FieldType **neighborRows)
+{
+    MPI_Aint size;
+    int unit;
+    FieldType *memory;
+    MPI_Win_shared_query(field->window, nodeRank, &size, &unit, &memory);
+
+    // The size of the segment is rounded up to pages, the neighbor's layout follows from its rows
+    int width = field->globalWidth;
+    int depth = field->haloDepth;
+    size_t cells = (size_t)width * (rows + 2 * depth);
+    for (int i = 0; i < 2; i++)
+        neighborRows[i] = memory + i * cells + calcIndex(width, 0, depth + (bottom ? rows - 1 : 0));
+}
+
+// Makes the stripes written so far (scattered, migrated or attached) visible to the neighbors. Collective over nodeComm,
+// only needed when all ranks replace their rows at once, the generations are synchronized with the counters.
+static inline void syncSharedWindowMPI(struct FieldMPI *field)
+{
+    MPI_Win_sync(field->window);
+    MPI_Barrier(field->nodeComm);
+    MPI_Win_sync(field->window);
+}
+
+// Moves both local stripes into a new shared memory window sized for the current rows, keeps the current generation.
+// Collective over nodeComm. The window stays locked (passive target epoch for all ranks), the accesses are
+// synchronized with MPI_Win_sync and the generation counters.
+static inline void attachSharedWindowMPI(struct FieldMPI *field)
+{
+    size_t cells = (size_t)field->globalWidth * (field->rows + 2 * field->haloDepth);
+
+    // Every rank's segment on its own pages, close to the rank on NUMA systems
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+
+    MPI_Win old = field->window;
+    FieldType *memory;
+    MPI_Win_allocate_shared((MPI_Aint)(2 * cells * sizeof(FieldType)), sizeof(FieldType), info, field->nodeComm, &memory,
+                            &field->window);
+    MPI_Info_free(&info);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, field->window);
+
+    // MPI_Win_allocate_shared does not zero the memory. Both halves are cleared because the ghost rows at a dead border
+    // are never written.
+    memset(memory, 0, 2 * cells * sizeof(FieldType));
+    memcpy(memory, field->currentField->field, cells * sizeof(FieldType));
+    for (int i = 0; i < 2; i++)
+    {
+        freeField(&field->fields[i]);
+        field->fields[i].field = memory + i * cells;
+        field->fields[i].buffer.memory = NULL;
+    }
+    field->currentField = &field->fields[0];
+    field->newField = &field->fields[1];
+
+    if (old != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(old);
+        MPI_Win_free(&old);
+    }
+
+    int nodeSize;
+    MPI_Comm_size(field->nodeComm, &nodeSize);
+    int *nodeRows = (int *)malloc(nodeSize * sizeof(int));
+    MPI_Allgather(&field->rows, 1, MPI_INT, nodeRows, 1, MPI_INT, field->nodeComm);
+    if (field->nodeUp >= 0)
+        sharedNeighborRowsMPI(field, field->nodeUp, nodeRows[field->nodeUp], true, field->sharedRows[0]);
+    if (field->nodeDown >= 0)
+        sharedNeighborRowsMPI(field, field->nodeDown, nodeRows[field->nodeDown], false, field->sharedRows[1]);
+    free(nodeRows);
+
+    syncSharedWindowMPI(field);
+}
+
+// Counter of the node rank in the counter window
+static inline long *sharedGenerationMPI(struct FieldMPI *field, int nodeRank)
+{
+    MPI_Aint size;
+    int unit;
+    long *counter;
+    MPI_Win_shared_query(field->counterWindow, nodeRank, &size, &unit, &counter);
+    return counter;
+}
+
+// Waits until the neighbors on the same node reached the generation of this rank: their rows of the generation are
+// complete, and they finished reading the previous generation of this rank, which the next step overwrites
+static inline void waitSharedNeighborsMPI(struct FieldMPI *field)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (field->sharedGenerations[i] == NULL)
+            continue;
+        while (__atomic_load_n(field->sharedGenerations[i], __ATOMIC_ACQUIRE) < field->generation)
+        {
+            // Yields to the neighbor if the ranks oversubscribe the cores
+            MPI_Win_sync(field->counterWindow);
+            sched_yield();
+        }
+    }
+    MPI_Win_sync(field->window);
+}
+
+// Tells the neighbors on the same node that the generation in currentField is complete
+static inline void publishSharedGenerationMPI(struct FieldMPI *field)
+{
+    MPI_Win_sync(field->window);
+    __atomic_store_n(field->publishedGeneration, field->generation, __ATOMIC_RELEASE);
+    MPI_Win_sync(field->counterWindow);
+}
+
+// Rank of neighbor in nodeComm, -1 if there is none or it is on another node
+static inline int nodeRankMPI(struct FieldMPI *field, int neighbor)
+{
+    if (neighbor == MPI_PROC_NULL)
+        return -1;
+
+    MPI_Group group;
+    MPI_Group nodeGroup;
+    MPI_Comm_group(field->comm, &group);
+    MPI_Comm_group(field->nodeComm, &nodeGroup);
+
+    int nodeRank;
+    MPI_Group_translate_ranks(group, 1, &neighbor, nodeGroup, &nodeRank);
+    MPI_Group_free(&group);
+    MPI_Group_free(&nodeGroup);
+    return nodeRank == MPI_UNDEFINED ? -1 : nodeRank;
+}
+
+// Exchanges the halos of neighbors on the same node through shared memory. nodeSize > 0 splits every node into groups
+// of nodeSize consecutive ranks, which emulates several nodes on a single machine. Collective, call it after
+// initializeFieldMPI and before scatterFieldMPI.
+static inline void enableSharedHalosMPI(struct FieldMPI *field, int nodeSize)
+{
+    MPI_Comm node;
+    MPI_Comm_split_type(field->comm, MPI_COMM_TYPE_SHARED, field->rank, MPI_INFO_NULL, &node);
+    if (nodeSize > 0)
+    {
+        MPI_Comm_split(node, field->rank / nodeSize, field->rank, &field->nodeComm);
+        MPI_Comm_free(&node);
+    }
+    else
+        field->nodeComm = node;
+
+    field->sharedHalos = true;
+    field->nodeUp = nodeRankMPI(field, field->up);
+    field->nodeDown = nodeRankMPI(field, field->down);
+    field->messageUp = field->nodeUp >= 0 ? MPI_PROC_NULL : field->up;
+    field->messageDown = field->nodeDown >= 0 ? MPI_PROC_NULL : field->down;
+
+    // One counter per rank, on its own page like the stripes
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    MPI_Win_allocate_shared((MPI_Aint)sizeof(long), sizeof(long), info, field->nodeComm, &field->publishedGeneration,
+                            &field->counterWindow);
+    MPI_Info_free(&info);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, field->counterWindow);
+    __atomic_store_n(field->publishedGeneration, field->generation, __ATOMIC_RELAXED);
+    if (field->nodeUp >= 0)
+        field->sharedGenerations[0] = sharedGenerationMPI(field, field->nodeUp);
+    if (field->nodeDown >= 0)
+        field->sharedGenerations[1] = sharedGenerationMPI(field, field->nodeDown);
+
+    // The barrier at the end also publishes the initial counters
+    attachSharedWindowMPI(field);
+}
+
+// Pins the OpenMP threads of every rank with the selected placement (gol_affinity.h), restricted to the CPUs of the
+// rank: ranks of a node with the same affinity mask (not bound by mpirun) split the selected CPUs among them, ranks
+// bound to their own CPUs use all of them. Collective.
+static inline void applyThreadPlacementMPI(MPI_Comm comm)
+{
+    if (threadAffinity.placement == PLACEMENT_NONE)
+        return;
+
+    MPI_Comm node;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+
+    unsigned long hash = 0;
+    for (size_t i = 0; i < PLACEMENT_MASK_WORDS; i++)
+        hash = hash * 0x9e3779b97f4a7c15ULL + threadAffinity.processMask[i];
+    MPI_Comm sameCpus;
+    MPI_Comm_split(node, (int)(hash % INT_MAX), 0, &sameCpus);
+
+    int part;
+    int parts;
+    MPI_Comm_rank(sameCpus, &part);
+    MPI_Comm_size(sameCpus, &parts);
+    restrictThreadPlacement(part, parts);
+    MPI_Comm_free(&sameCpus);
+    MPI_Comm_free(&node);
+
+    // One thread per CPU of the rank unless the number of threads is given, like the single process build
+    if ((threadAffinity.placement == PLACEMENT_PHYSICAL || threadAffinity.placement == PLACEMENT_LIST) && getenv("OMP_NUM_THREADS") == NULL)
+        omp_set_num_threads(threadAffinity.count);
+    applyThreadPlacement(0);
+}
+
+// Distributes the rows of a global field (only read on rank 0) to all ranks
+static inline void scatterFieldMPI(struct FieldMPI *field, struct Field *global)
+{
+    int *counts = (int *)malloc(field->size * sizeof(int));
+    int *displacements = (int *)malloc(field->size * sizeof(int));
+
+    int count = field->rows * field->globalWidth;
+    int displacement = field->startY * field->globalWidth;
+    MPI_Allgather(&count, 1, MPI_INT, counts, 1, MPI_INT, field->comm);
+    MPI_Allgather(&displacement, 1, MPI_INT, displacements, 1, MPI_INT, field->comm);
+
+    MPI_Scatterv(field->rank == 0 ? global->field : NULL, counts, displacements, MPI_CHAR,
+                 localRowMPI(field->currentField, field->haloDepth, 0), count, MPI_CHAR, 0, field->comm);
+    field->validDepth = 0;
+    if (field->sharedHalos)
+        syncSharedWindowMPI(field);
+
+    free(counts);
+    free(displacements);
+}
+
+// Collects the rows of all ranks into a global field (only written on rank 0)
+static inline void gatherFieldMPI(struct FieldMPI *field, struct Field *global)
+{
+    int *counts = (int *)malloc(field->size * sizeof(int));
+    int *displacements = (int *)malloc(field->size * sizeof(int));
+
+    int count = field->rows * field->globalWidth;
+    int displacement = field->startY * field->globalWidth;
+    MPI_Allgather(&count, 1, MPI_INT, counts, 1, MPI_INT, field->comm);
+    MPI_Allgather(&displacement, 1, MPI_INT, displacements, 1, MPI_INT, field->comm);
+
+    MPI_Gatherv(localRowMPI(field->currentField, field->haloDepth, 0), count, MPI_CHAR,
+                field->rank == 0 ? global->field : NULL, counts, displacements, MPI_CHAR, 0, field->comm);
+
+    free(counts);
+    free(displacements);
+}
+
+static inline bool atTopBorderMPI(struct FieldMPI *field)
+{
+    return field->boundary != BOUNDARY_TORUS && field->startY == 0;
+}
+
+static inline bool atBottomBorderMPI(struct FieldMPI *field)
+{
+    return field->boundary != BOUNDARY_TORUS && field->startY + field->rows == field->globalHeight;
+}
+
+// Mirrors the owned rows into the ghost rows outside of the board (reflect mode only)
+static inline void reflectHalosMPI(struct FieldMPI *field)
+{
+    if (field->boundary != BOUNDARY_REFLECT)
+        return;
+
+    int width = field->globalWidth;
+    int depth = field->haloDepth;
+    for (int k = 0; k < depth; k++)
+    {
+        if (atTopBorderMPI(field))
+            memcpy(localRowMPI(field->currentField, depth, -1 - k), localRowMPI(field->currentField, depth, k), width);
+        if (atBottomBorderMPI(field))
+            memcpy(localRowMPI(field->currentField, depth, field->rows + k),
+                   localRowMPI(field->currentField, depth, field->rows - 1 - k), width);
+    }
+}
+
+// Exchanges haloDepth rows with the neighbors on other nodes, afterwards haloDepth generations can be computed locally
+static inline void exchangeHalosMPI(struct FieldMPI *field)
+{
+    double start = MPI_Wtime();
+
+    int depth = field->haloDepth;
+    int count = depth * field->globalWidth;
+    struct Field *local = field->currentField;
+
+    // Own top rows -> upper neighbor, lower neighbor's top rows -> bottom ghost rows
+    MPI_Sendrecv(localRowMPI(local, depth, 0), count, MPI_CHAR, field->messageUp, 0,
+                 localRowMPI(local, depth, field->rows), count, MPI_CHAR, field->messageDown, 0,
+                 field->comm, MPI_STATUS_IGNORE);
+    // Own bottom rows -> lower neighbor, upper neighbor's bottom rows -> top ghost rows
+    MPI_Sendrecv(localRowMPI(local, depth, field->rows - depth), count, MPI_CHAR, field->messageDown, 1,
+                 localRowMPI(local, depth, -depth), count, MPI_CHAR, field->messageUp, 1,
+                 field->comm, MPI_STATUS_IGNORE);
+
+    int messages = (field->messageUp != MPI_PROC_NULL) + (field->messageDown != MPI_PROC_NULL);
+    field->messages += messages;
+    field->bytesSent += (long)count * messages;
+
+    field->exchanges++;
+    field->validDepth = depth;
+
+    reflectHalosMPI(field);
+
+    field->exchangeTime += MPI_Wtime() - start;
+}
+
+// Advances the distributed field by one generation, communicates only every haloDepth generations
+static inline void simulateStepMPIPlain(struct FieldMPI *field, int timestep)
 {
-    // TODO: Implement
+    if (field->validDepth == 0)
+        exchangeHalosMPI(field);
+    if (field->sharedHalos)
+    {
+        double start = MPI_Wtime();
+        waitSharedNeighborsMPI(field);
+        field->exchangeTime += MPI_Wtime() - start;
+    }
+
+    double start = MPI_Wtime();
+
+    // The valid region shrinks by one row per generation on every side that exchanges messages with another rank
+    int depth = field->haloDepth;
+    int shrink = field->validDepth - 1;
+    int startRow = atTopBorderMPI(field) || field->nodeUp >= 0 ? 0 : -shrink;
+    int endRow = atBottomBorderMPI(field) || field->nodeDown >= 0 ? field->rows : field->rows + shrink;
+
+    struct Field *currentField = field->currentField;
+    struct Field *newField = field->newField;
+    int width = currentField->width;
+
+    // All ranks swap their fields together, the neighbors' current generation has the same index
+    int current = currentField == &field->fields[0] ? 0 : 1;
+    const FieldType *sharedAbove = field->nodeUp >= 0 ? field->sharedRows[0][current] : NULL;
+    const FieldType *sharedBelow = field->nodeDown >= 0 ? field->sharedRows[1][current] : NULL;
+
+    #pragma omp parallel for
+    for (int row = startRow; row < endRow; row++)
+    {
+        // The first and last owned row read the boundary rows of neighbors on the same node directly in the window
+        const FieldType *above = row == 0 && sharedAbove != NULL ? sharedAbove : localRowMPI(currentField, depth, row - 1);
+        const FieldType *below = row == field->rows - 1 && sharedBelow != NULL ? sharedBelow : localRowMPI(currentField, depth, row + 1);
+        golKernelRows(above, localRowMPI(currentField, depth, row), below, localRowMPI(newField, depth, row), width, field->boundary);
+    }
+    field->bytesShared += (long)width * ((sharedAbove != NULL) + (sharedBelow != NULL));
+
+    field->currentField = newField;
+    field->newField = currentField;
+    field->validDepth--;
+    field->generation++;
+
+    reflectHalosMPI(field);
+
+    if (field->sharedHalos)
+        publishSharedGenerationMPI(field);
+
+    field->computeTime += MPI_Wtime() - start;
+}
+
+//
+// Load Balancing
+//
+
+#define REBALANCE_MIN_IMBALANCE 1.02 // max / mean cost below which differences are treated as measurement noise
+
+// Stripe borders: rank r owns the rows [borders[r], borders[r + 1])
+static inline void gatherStripeBordersMPI(struct FieldMPI *field, int *borders)
+{
+    MPI_Allgather(&field->startY, 1, MPI_INT, borders, 1, MPI_INT, field->comm);
+    borders[field->size] = field->globalHeight;
 }
 
+// Cost of the rows [start, end) if every rank's cost is spread evenly over its old rows
+static inline double stripeCostMPI(const int *borders, const double *costs, int size, int start, int end)
+{
+    double cost = 0;
+    for (int r = 0; r < size; r++)
+    {
+        int overlap = MIN(end, borders[r + 1]) - MAX(start, borders[r]);
+        if (overlap > 0)
+            cost += costs[r] * overlap / (borders[r + 1] - borders[r]);
+    }
+    return cost;
+}
+
+// Weighted stripes: new borders that split the measured cost evenly, every stripe keeps at least minRows rows
+static inline void weightedStripesMPI(const int *borders, const double *costs, int size, int height, int minRows, int *newBorders)
+{
+    double total = 0;
+    for (int r = 0; r < size; r++)
+        total += costs[r];
+
+    // Walks the old stripes once, the cost of a row is constant within an old stripe
+    newBorders[0] = 0;
+    int r = 0;
+    double before = 0; // cost of the old stripes before r
+    for (int k = 1; k < size; k++)
+    {
+        double target = total * k / size;
+        while (r < size - 1 && before + costs[r] < target)
+            before += costs[r++];
+
+        int rows = borders[r + 1] - borders[r];
+        double rowCost = costs[r] / MAX(rows, 1);
+        int offset = rowCost > 0 ? (int)((target - before) / rowCost + 0.5) : rows / 2;
+        newBorders[k] = borders[r] + MIN(MAX(offset, 0), rows);
+    }
+    newBorders[size] = height;
+
+    for (int k = 1; k < size; k++)
+        newBorders[k] = MAX(newBorders[k], newBorders[k - 1] + minRows);
+    for (int k = size - 1; k > 0; k--)
+        newBorders[k] = MIN(newBorders[k], newBorders[k + 1] - minRows);
+}
+
+// Moves the owned rows to the new stripes with a single all to all exchange, the ghost rows are exchanged again
+static inline void migrateStripesMPI(struct FieldMPI *field, const int *borders, const int *newBorders)
+{
+    int width = field->globalWidth;
+    int depth = field->haloDepth;
+    int start = newBorders[field->rank];
+    int rows = newBorders[field->rank + 1] - start;
+
+    struct Field fields[2];
+    for (int i = 0; i < 2; i++)
+    {
+        initializeField(&fields[i], width, rows + 2 * depth, 1, 1);
+        fields[i].boundary = field->boundary;
+    }
+
+    int *sendCounts = (int *)calloc(4 * field->size, sizeof(int));
+    int *sendDisplacements = sendCounts + field->size;
+    int *receiveCounts = sendCounts + 2 * field->size;
+    int *receiveDisplacements = sendCounts + 3 * field->size;
+    for (int r = 0; r < field->size; r++)
+    {
+        // Old rows of this rank that rank r owns afterwards
+        int sendStart = MAX(field->startY, newBorders[r]);
+        int sendEnd = MIN(field->startY + field->rows, newBorders[r + 1]);
+        if (sendEnd > sendStart)
+        {
+            sendCounts[r] = (sendEnd - sendStart) * width;
+            sendDisplacements[r] = (sendStart - field->startY) * width;
+        }
+
+        // New rows of this rank that rank r owned before
+        int receiveStart = MAX(start, borders[r]);
+        int receiveEnd = MIN(start + rows, borders[r + 1]);
+        if (receiveEnd > receiveStart)
+        {
+            receiveCounts[r] = (receiveEnd - receiveStart) * width;
+            receiveDisplacements[r] = (receiveStart - start) * width;
+            if (r != field->rank)
+                field->migratedBytes += receiveCounts[r];
+        }
+    }
+
+    MPI_Alltoallv(localRowMPI(field->currentField, depth, 0), sendCounts, sendDisplacements, MPI_CHAR,
+                  localRowMPI(&fields[0], depth, 0), receiveCounts, receiveDisplacements, MPI_CHAR, field->comm);
+    free(sendCounts);
+
+    // No-ops for stripes in a shared window
+    freeField(&field->fields[0]);
+    freeField(&field->fields[1]);
+    field->fields[0] = fields[0];
+    field->fields[1] = fields[1];
+    field->currentField = &field->fields[0];
+    field->newField = &field->fields[1];
+
+    field->startY = start;
+    field->rows = rows;
+    field->validDepth = 0;
+
+    // The old window is still read by the all to all exchange above, it is replaced afterwards
+    if (field->sharedHalos)
+        attachSharedWindowMPI(field);
+}
+
+// Compares the compute time of the ranks since the last check (rebalanceInterval generations ago) and moves the
+// stripe borders if the predicted gain over the remaining generations exceeds the predicted migration cost. The
+// migration cost is estimated from the measured latency of the cost exchange and the time per byte of the halo
+// exchanges (which includes waiting for neighbors, so it is rather too high). Rank 0 prints one line per check.
+// With rebalanceAlways every change of the stripes is applied, which exercises the migration on balanced runs.
+static inline void rebalanceFieldMPI(struct FieldMPI *field, int generation, int remaining)
+{
+    if (field->size == 1)
+        return;
+
+    double start = MPI_Wtime();
+    double local[2] = {field->computeTime - field->balancedComputeTime, field->exchangeTime / MAX(field->bytesSent + field->bytesShared, 1)};
+    double *measured = (double *)malloc(2 * field->size * sizeof(double));
+    MPI_Allgather(local, 2, MPI_DOUBLE, measured, 2, MPI_DOUBLE, field->comm);
+    field->balancedComputeTime = field->computeTime;
+
+    // The decision has to be the same on all ranks, so they agree on the slowest latency as well
+    double latency = MPI_Wtime() - start;
+    MPI_Allreduce(MPI_IN_PLACE, &latency, 1, MPI_DOUBLE, MPI_MAX, field->comm);
+
+    int *borders = (int *)malloc(2 * (field->size + 1) * sizeof(int));
+    int *newBorders = borders + field->size + 1;
+    gatherStripeBordersMPI(field, borders);
+
+    double *costs = (double *)malloc(field->size * sizeof(double));
+    double secondsPerByte = 0;
+    double maxCost = 0;
+    double meanCost = 0;
+    for (int r = 0; r < field->size; r++)
+    {
+        costs[r] = measured[2 * r];
+        secondsPerByte = MAX(secondsPerByte, measured[2 * r + 1]);
+        maxCost = MAX(maxCost, costs[r]);
+        meanCost += costs[r] / field->size;
+    }
+
+    // Every rank computes the same borders from the same costs
+    weightedStripesMPI(borders, costs, field->size, field->globalHeight, field->haloDepth, newBorders);
+
+    double predictedMaxCost = 0;
+    long maxMovedRows = 0;
+    long movedRows = 0;
+    for (int r = 0; r < field->size; r++)
+    {
+        predictedMaxCost = MAX(predictedMaxCost, stripeCostMPI(borders, costs, field->size, newBorders[r], newBorders[r + 1]));
+
+        // Rows rank r receives from other ranks
+        int rows = newBorders[r + 1] - newBorders[r];
+        int kept = MAX(0, MIN(borders[r + 1], newBorders[r + 1]) - MAX(borders[r], newBorders[r]));
+        maxMovedRows = MAX(maxMovedRows, rows - kept);
+        movedRows += rows - kept;
+    }
+
+    double gain = (maxCost - predictedMaxCost) / MAX(field->rebalanceInterval, 1) * remaining;
+    double cost = 2 * latency + (double)maxMovedRows * field->globalWidth * secondsPerByte;
+    bool apply = movedRows > 0 && (field->rebalanceAlways || (maxCost > REBALANCE_MIN_IMBALANCE * meanCost && gain > cost));
+
+    if (field->rank == 0)
+    {
+        printf("rebalance generation=%d imbalance=%f predicted_imbalance=%f moved_rows=%ld moved_bytes=%ld gain=%e cost=%e applied=%d\n",
+               generation, maxCost / MAX(meanCost, 1e-12), predictedMaxCost / MAX(meanCost, 1e-12), movedRows,
+               movedRows * field->globalWidth, gain, cost, apply);
+        fflush(stdout);
+    }
+
+    if (apply)
+    {
+        migrateStripesMPI(field, borders, newBorders);
+        field->rebalances++;
+    }
+
+    free(costs);
+    free(borders);
+    free(measured);
+}
+
+static inline void simulateStepsMPI(int timesteps, struct FieldMPI *field)
+{
+    for (int t = 0; t < timesteps; t++)
+    {
+        simulateStepMPIPlain(field, t);
+
+        if (field->rebalanceInterval > 0 && (t + 1) % field->rebalanceInterval == 0 && t + 1 < timesteps)
+            rebalanceFieldMPI(field, t + 1, timesteps - t - 1);
+    }
+}
+
+// Prints a single key=value line on rank 0 (parsed by src/benchmark.py)
+static inline void printStatisticsMPI(struct FieldMPI *field, int timesteps, double elapsed)
+{
+    double times[3] = {elapsed, field->exchangeTime, field->computeTime};
+    double maxTimes[3];
+    long counts[4] = {field->messages, field->bytesSent, field->migratedBytes, field->bytesShared};
+    long totalCounts[4];
+
+    MPI_Reduce(times, maxTimes, 3, MPI_DOUBLE, MPI_MAX, 0, field->comm);
+    MPI_Reduce(counts, totalCounts, 4, MPI_LONG, MPI_SUM, 0, field->comm);
+
+    if (field->rank == 0)
+    {
+        printf("mpi ranks=%d threads=%d width=%d height=%d timesteps=%d halo_depth=%d "
+               "elapsed=%f exchange=%f compute=%f step=%e exchanges=%ld messages=%ld bytes=%ld "
+               "rebalance_interval=%d rebalances=%ld migrated_bytes=%ld shared_halos=%d shared_bytes=%ld\n",
+               field->size, omp_get_max_threads(), field->globalWidth, field->globalHeight, timesteps, field->haloDepth,
+               maxTimes[0], maxTimes[1], maxTimes[2], maxTimes[0] / MAX(timesteps, 1),
+               field->exchanges, totalCounts[0], totalCounts[1], field->rebalanceInterval, field->rebalances,
+               totalCounts[2], field->sharedHalos, totalCounts[3]);
+        fflush(stdout);
+    }
+}
+
+#endif // USE_MPI
+
 #endif // GOL_MPI
@@ -3,36 +3,78 @@
 
 #include "gol_field.h"
 #include "gol_plain_utils.h"
+#include "gol_affinity.h"
+#include "gol_trace.h"
+
+// Cells of segment s, segments are numbered in column major order
+static inline void segmentBounds(struct Field *field, int s, int *startX, int *endX, int *startY, int *endY)
+{
+    int i = s / field->segmentsY;
+    int j = s % field->segmentsY;
+
+    *startX = field->factorX * i + 0.5;
+    *startY = field->factorY * j + 0.5;
+
+    *endX = field->factorX * (i + 1) + 0.5;
+    *endY = field->factorY * (j + 1) + 0.5;
+}
 
 static inline void simulateStepOMPPlain(struct Field *currentField, struct Field *newField, int timestep)
 {
-    VTK_INIT
+    int borderCells = borderCellCount(currentField);
+    bool tracking = currentField->tracking != 0;
+
+    // Per thread statistics, reduced without atomics at the end of the parallel region
+    struct FieldStatistics statistics;
+    initializeFieldStatistics(&statistics);
 
-    #pragma omp parallel for collapse(2)
-    for (int i = 0; i < currentField->segmentsX; i++)
+    TRACE_BEGIN(traceStep)
+    #pragma omp parallel reduction(mergeStatistics : statistics)
     {
-        for (int j = 0; j < currentField->segmentsY; j++)
+        struct FieldStatistics *tracked = tracking ? &statistics : NULL;
+
+        // Static schedule over the segments in column major order, threads take their share in topology order so
+        // neighboring segments run on neighboring cores (see gol_affinity.h)
+        int segments = currentField->segmentsX * currentField->segmentsY;
+        int rank = segmentRank();
+        int threads = omp_get_num_threads();
+        for (int s = (long)segments * rank / threads; s < (long)segments * (rank + 1) / threads; s++)
         {
-            int startX = currentField->factorX * i + 0.5;
-            int startY = currentField->factorY * j + 0.5;
+            int startX, endX, startY, endY;
+            segmentBounds(currentField, s, &startX, &endX, &startY, &endY);
 
-            int endX = currentField->factorX * (i + 1) + 0.5;
-            int endY = currentField->factorY * (j + 1) + 0.5;
+            TRACE_BEGIN(traceSegment)
+            golKernelInteriorRegion(currentField, newField, startX, endX, startY, endY, tracked);
+            TRACE_END(traceSegment, TRACE_SEGMENT, timestep, s)
+        }
+
+        // Separate border pass, the interior never checks boundaries
+        TRACE_BEGIN(traceBorder)
+        #pragma omp for nowait
+        for (int i = 0; i < borderCells; i++)
+        {
+            golKernelBorderCell(currentField, newField, i, tracked);
+        }
+        TRACE_END(traceBorder, TRACE_BORDER, timestep, -1)
 
-            int x, y;
-            for (y = startY; y < endY; y++)
+        // The density blocks across the seams of a segment need the cells of the neighbors and the border
+        if (currentField->tracking & TRACK_DENSITY)
+        {
+            #pragma omp barrier
+            for (int s = (long)segments * rank / threads; s < (long)segments * (rank + 1) / threads; s++)
             {
-                for (x = startX; x < endX; x++)
-                {
-                    golKernel(currentField, newField, x, y);
-                }
+                int startX, endX, startY, endY;
+                segmentBounds(currentField, s, &startX, &endX, &startY, &endY);
+                completeDensitySegment(newField, startX, endX, startY, endY);
             }
-
-            VTK_OUTPUT_SEGMENT(timestep, startX, endX, startY, endY)
         }
+
+        // The region ends with a barrier anyway, the traced one measures the wait for the slowest thread
+        TRACE_BARRIER_WAIT(timestep)
     }
+    TRACE_END(traceStep, TRACE_STEP, timestep, -1)
 
-    VTK_OUTPUT_MASTER(timestep)
+    newField->statistics = statistics;
 }
 
-#endif // GOL_OMP
\ No newline at end of file
+#endif // GOL_OMP
@@ -0,0 +1,484 @@
+#ifndef GOL_OUTPUT
+#define GOL_OUTPUT
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "gol_field.h"
+#include "gol_affinity.h"
+
+//
+// Asynchronous Output
+//
+// Selected generations are copied into one of a fixed number of snapshot slots and queued. Dedicated I/O threads
+// write the queued snapshots as VTK files (one .vti per segment and a .pvti master) while the engine computes the
+// next generations. If every slot is still queued or being written the simulation waits for a free one, so the
+// memory stays bounded and a slow disk throttles the simulation instead of being overrun.
+//
+// Besides full resolution dumps a slot can hold a density pyramid: the live cells of 4 x 4, 16 x 16, 64 x 64, ...
+// blocks. The engine sums the 4 x 4 blocks while it writes the generation (TRACK_DENSITY, see prepareOutput), the
+// coarser levels only read these sums. Only a few bytes per block are queued and written, which makes it cheap enough
+// to monitor large boards every few generations.
+//
+
+#define OUTPUT_DEFAULT_DEPTH 4
+#define OUTPUT_DEFAULT_THREADS 2
+
+#define PYRAMID_MAX_LEVELS 8
+#define PYRAMID_FACTOR 4 // blocks of level l + 1 consist of 4 x 4 blocks of level l (level 0 relies on 4)
+
+struct DensityPyramid
+{
+    int levels;
+    int width[PYRAMID_MAX_LEVELS]; // blocks per level, partial blocks at the right and bottom border included
+    int height[PYRAMID_MAX_LEVELS];
+    int blockSize[PYRAMID_MAX_LEVELS]; // cells per block side, PYRAMID_FACTOR^(level + 1)
+    uint32_t *sums[PYRAMID_MAX_LEVELS]; // live cells per block
+};
+
+struct OutputSlot
+{
+    long generation;
+    bool full;    // snapshot holds the generation
+    bool pyramid; // pyramid holds the generation
+
+    struct Field snapshot;
+    struct DensityPyramid densities;
+};
+
+struct OutputPipeline
+{
+    char pathPrefix[1024];
+    int every;        // write every n-th generation in full resolution, 0 disables them
+    int pyramidEvery; // write the density pyramid of every n-th generation, 0 disables them
+
+    int depth;               // number of slots, i.e. the maximum number of generations in flight
+    struct OutputSlot *slots;
+    int *available;          // stack of free slot indices
+    int availableCount;
+    int *queue;              // ring of slot indices waiting to be written
+    int queueStart;
+    int queueCount;
+
+    int threadCount;
+    pthread_t *threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;   // a slot was queued or the pipeline stops
+    pthread_cond_t released; // a slot was written and is free again
+    bool stopping;
+
+    // Statistics
+    long written;       // written generations
+    long bytesWritten;  // cell and block data of all files
+    double copyTime;    // snapshot copies and pyramids on the simulation thread
+    double stallTime;   // simulation thread waiting for a free slot
+};
+
+//
+// Density Pyramid
+//
+
+static inline void initializeDensityPyramid(struct DensityPyramid *pyramid, int width, int height, int levels)
+{
+    pyramid->levels = MAX(1, MIN(levels, PYRAMID_MAX_LEVELS));
+
+    int blockSize = 1;
+    for (int level = 0; level < pyramid->levels; level++)
+    {
+        blockSize *= PYRAMID_FACTOR;
+        pyramid->blockSize[level] = blockSize;
+        pyramid->width[level] = (width + blockSize - 1) / blockSize;
+        pyramid->height[level] = (height + blockSize - 1) / blockSize;
+        pyramid->sums[level] = (uint32_t *)calloc((size_t)pyramid->width[level] * pyramid->height[level], sizeof(uint32_t));
+    }
+}
+
+static inline void freeDensityPyramid(struct DensityPyramid *pyramid)
+{
+    for (int level = 0; level < pyramid->levels; level++)
+    {
+        free(pyramid->sums[level]);
+    }
+}
+
+// All levels of the field, every block row is computed by one thread. Level 0 is taken over from the engine if it
+// tracked the densities of the generation (the block sums move into the pyramid).
+static inline void computeDensityPyramid(struct DensityPyramid *pyramid, struct Field *field)
+{
+    if ((field->tracking & TRACK_DENSITY) && field->densities != NULL)
+    {
+        // Same layout, the buffers are exchanged instead of copied
+        uint32_t *sums = pyramid->sums[0];
+        pyramid->sums[0] = field->densities;
+        field->densities = sums;
+        field->tracking &= ~TRACK_DENSITY;
+    }
+    else
+    {
+        // Level 0 from the cells: the rows of a block row are added cell wise (vectorized), then 4 adjacent sums (each
+        // at most 4) are added in the top byte of a multiplication
+        #pragma omp parallel
+        {
+            FieldType *column = (FieldType *)malloc(field->width + sizeof(uint32_t));
+
+            #pragma omp for
+            for (int by = 0; by < pyramid->height[0]; by++)
+            {
+                memset(column, 0, field->width + sizeof(uint32_t));
+                int rows = MIN(PYRAMID_FACTOR, field->height - by * PYRAMID_FACTOR);
+                const FieldType *row = field->field + calcIndex(field->width, 0, by * PYRAMID_FACTOR);
+                if (rows == PYRAMID_FACTOR)
+                {
+                    const int width = field->width;
+                    for (int x = 0; x < width; x++)
+                    {
+                        column[x] = row[x] + row[x + width] + row[x + 2 * width] + row[x + 3 * width];
+                    }
+                }
+                else
+                {
+                    for (int y = 0; y < rows; y++)
+                    {
+                        for (int x = 0; x < field->width; x++)
+                        {
+                            column[x] += row[calcIndex(field->width, x, y)];
+                        }
+                    }
+                }
+
+                uint32_t *sums = pyramid->sums[0] + calcIndex(pyramid->width[0], 0, by);
+                for (int bx = 0; bx < pyramid->width[0]; bx++)
+                {
+                    uint32_t word;
+                    memcpy(&word, column + bx * PYRAMID_FACTOR, sizeof(word));
+                    sums[bx] = (word * 0x01010101u) >> 24;
+                }
+            }
+
+            free(column);
+        }
+    }
+
+    // Coarser levels from the previous one in the same way
+    for (int level = 1; level < pyramid->levels; level++)
+    {
+        int fineWidth = pyramid->width[level - 1];
+        int fineHeight = pyramid->height[level - 1];
+
+        #pragma omp parallel
+        {
+            uint32_t *column = (uint32_t *)malloc((fineWidth + PYRAMID_FACTOR) * sizeof(uint32_t));
+
+            #pragma omp for
+            for (int by = 0; by < pyramid->height[level]; by++)
+            {
+                memset(column, 0, (fineWidth + PYRAMID_FACTOR) * sizeof(uint32_t));
+                int endY = MIN((by + 1) * PYRAMID_FACTOR, fineHeight);
+                for (int y = by * PYRAMID_FACTOR; y < endY; y++)
+                {
+                    const uint32_t *fine = pyramid->sums[level - 1] + calcIndex(fineWidth, 0, y);
+                    for (int x = 0; x < fineWidth; x++)
+                    {
+                        column[x] += fine[x];
+                    }
+                }
+
+                uint32_t *sums = pyramid->sums[level] + calcIndex(pyramid->width[level], 0, by);
+                for (int bx = 0; bx < pyramid->width[level]; bx++)
+                {
+                    const uint32_t *block = column + bx * PYRAMID_FACTOR;
+                    sums[bx] = block[0] + block[1] + block[2] + block[3];
+                }
+            }
+
+            free(column);
+        }
+    }
+}
+
+// Writes one level as image with one cell per block and the density (live cells / cells of the block) as value
+static inline long writeVTKDensity(struct DensityPyramid *pyramid, int level, int fieldWidth, int fieldHeight, const char *pathPrefix,
+                                   const char *prefix)
+{
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s%s_lod%d.vti", pathPrefix, prefix, pyramid->blockSize[level]);
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+        return 0;
+
+    int width = pyramid->width[level];
+    int height = pyramid->height[level];
+    int blockSize = pyramid->blockSize[level];
+    long nxy = (long)width * height * sizeof(float);
+
+    fprintf(fp, "<?xml version=\"1.0\"?>\n");
+    fprintf(fp, "<VTKFile type=\"ImageData\" version=\"0.1\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n");
+    fprintf(fp, "<ImageData WholeExtent=\"0 %d 0 %d 0 0\" Origin=\"0 0 0\" Spacing=\"%d %d 0\">\n", width, height, blockSize, blockSize);
+    fprintf(fp, "<CellData Scalars=\"density\">\n");
+    fprintf(fp, "<DataArray type=\"Float32\" Name=\"density\" format=\"appended\" offset=\"0\"/>\n");
+    fprintf(fp, "</CellData>\n");
+    fprintf(fp, "</ImageData>\n");
+    fprintf(fp, "<AppendedData encoding=\"raw\">\n");
+    fprintf(fp, "_");
+    fwrite((unsigned char *)&nxy, sizeof(long), 1, fp);
+
+    float *values = (float *)malloc(width * sizeof(float));
+    for (int y = 0; y < height; y++)
+    {
+        int cellsY = MIN(blockSize, fieldHeight - y * blockSize);
+        for (int x = 0; x < width; x++)
+        {
+            int cellsX = MIN(blockSize, fieldWidth - x * blockSize);
+            values[x] = pyramid->sums[level][calcIndex(width, x, y)] / (float)(cellsX * cellsY);
+        }
+        fwrite((unsigned char *)values, sizeof(float), width, fp);
+    }
+    free(values);
+
+    fprintf(fp, "\n</AppendedData>\n");
+    fprintf(fp, "</VTKFile>\n");
+    fclose(fp);
+    return nxy;
+}
+
+// Writes every level and a .vtm multiblock file that groups them
+static inline long writeVTKPyramid(struct DensityPyramid *pyramid, int fieldWidth, int fieldHeight, const char *pathPrefix,
+                                   const char *prefix)
+{
+    long bytes = 0;
+    for (int level = 0; level < pyramid->levels; level++)
+    {
+        bytes += writeVTKDensity(pyramid, level, fieldWidth, fieldHeight, pathPrefix, prefix);
+    }
+
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s%s_lod.vtm", pathPrefix, prefix);
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+        return bytes;
+
+    fprintf(fp, "<?xml version=\"1.0\"?>\n");
+    fprintf(fp, "<VTKFile type=\"vtkMultiBlockDataSet\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n");
+    fprintf(fp, "<vtkMultiBlockDataSet>\n");
+    for (int level = 0; level < pyramid->levels; level++)
+    {
+        fprintf(fp, "<DataSet index=\"%d\" name=\"%dx%d\" file=\"%s_lod%d.vti\"/>\n", level, pyramid->blockSize[level],
+                pyramid->blockSize[level], prefix, pyramid->blockSize[level]);
+    }
+    fprintf(fp, "</vtkMultiBlockDataSet>\n");
+    fprintf(fp, "</VTKFile>\n");
+    fclose(fp);
+    return bytes;
+}
+
+//
+// Pipeline
+//
+
+static inline void writeOutputSlot(struct OutputPipeline *pipeline, struct OutputSlot *slot)
+{
+    char prefix[1024];
+    snprintf(prefix, sizeof(prefix), "gol_mtp_%05ld", slot->generation);
+    struct Field *snapshot = &slot->snapshot;
+
+    if (slot->full)
+    {
+        for (int i = 0; i < snapshot->segmentsX; i++)
+        {
+            for (int j = 0; j < snapshot->segmentsY; j++)
+            {
+                int startX = snapshot->factorX * i + 0.5;
+                int startY = snapshot->factorY * j + 0.5;
+
+                int endX = snapshot->factorX * (i + 1) + 0.5;
+                int endY = snapshot->factorY * (j + 1) + 0.5;
+
+                writeVTK2(snapshot, pipeline->pathPrefix, prefix, startX, endX, startY, endY);
+            }
+        }
+        writeVTK2Master(snapshot, pipeline->pathPrefix, prefix);
+    }
+
+    long bytes = slot->full ? (long)snapshot->width * snapshot->height * sizeof(float) : 0;
+    if (slot->pyramid)
+        bytes += writeVTKPyramid(&slot->densities, snapshot->width, snapshot->height, pipeline->pathPrefix, prefix);
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->bytesWritten += bytes;
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+static void *runOutputThread(void *argument)
+{
+    struct OutputPipeline *pipeline = (struct OutputPipeline *)argument;
+    unpinThread();
+
+    pthread_mutex_lock(&pipeline->mutex);
+    while (true)
+    {
+        while (pipeline->queueCount == 0 && !pipeline->stopping)
+            pthread_cond_wait(&pipeline->queued, &pipeline->mutex);
+
+        // The queue is drained before stopping
+        if (pipeline->queueCount == 0)
+            break;
+
+        int slot = pipeline->queue[pipeline->queueStart];
+        pipeline->queueStart = (pipeline->queueStart + 1) % pipeline->depth;
+        pipeline->queueCount--;
+
+        pthread_mutex_unlock(&pipeline->mutex);
+        writeOutputSlot(pipeline, &pipeline->slots[slot]);
+        pthread_mutex_lock(&pipeline->mutex);
+
+        pipeline->available[pipeline->availableCount++] = slot;
+        pipeline->written++;
+        pthread_cond_signal(&pipeline->released);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    return NULL;
+}
+
+// Slots have the size and segmentation of field, pathPrefix is created if it does not exist.
+// every / pyramidEvery select the full resolution / pyramid generations (0 disables them), levels is the pyramid depth.
+static inline void initializeOutputPipeline(struct OutputPipeline *pipeline, struct Field *field, const char *pathPrefix, int every,
+                                            int pyramidEvery, int levels, int depth, int threadCount)
+{
+    snprintf(pipeline->pathPrefix, sizeof(pipeline->pathPrefix), "%s", pathPrefix);
+    mkdir(pathPrefix, 0755);
+
+    pipeline->every = MAX(every, 0);
+    pipeline->pyramidEvery = MAX(pyramidEvery, 0);
+    pipeline->depth = MAX(depth, 1);
+    pipeline->threadCount = MAX(threadCount, 1);
+
+    pipeline->slots = (struct OutputSlot *)calloc(pipeline->depth, sizeof(struct OutputSlot));
+    pipeline->available = (int *)malloc(pipeline->depth * sizeof(int));
+    pipeline->queue = (int *)malloc(pipeline->depth * sizeof(int));
+    for (int i = 0; i < pipeline->depth; i++)
+    {
+        struct OutputSlot *slot = &pipeline->slots[i];
+
+        // The snapshot keeps the geometry for the pyramid, its cells are only needed for full resolution dumps
+        slot->snapshot = *field;
+        slot->snapshot.field = NULL;
+        slot->snapshot.buffer.memory = NULL;
+        slot->snapshot.densities = NULL;
+        if (pipeline->every > 0)
+            initializeFieldOther(&slot->snapshot, field);
+        if (pipeline->pyramidEvery > 0)
+            initializeDensityPyramid(&slot->densities, field->width, field->height, levels);
+
+        pipeline->available[i] = i;
+    }
+    pipeline->availableCount = pipeline->depth;
+    pipeline->queueStart = 0;
+    pipeline->queueCount = 0;
+
+    pipeline->stopping = false;
+    pipeline->written = 0;
+    pipeline->bytesWritten = 0;
+    pipeline->copyTime = 0;
+    pipeline->stallTime = 0;
+
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->queued, NULL);
+    pthread_cond_init(&pipeline->released, NULL);
+
+    pipeline->threads = (pthread_t *)malloc(pipeline->threadCount * sizeof(pthread_t));
+    for (int i = 0; i < pipeline->threadCount; i++)
+    {
+        pthread_create(&pipeline->threads[i], NULL, runOutputThread, pipeline);
+    }
+}
+
+// Called before the step that writes generation into newField: selects TRACK_DENSITY for the pyramid generations, so
+// the engine sums the 4 x 4 blocks while the rows are in cache
+static inline void prepareOutput(struct OutputPipeline *pipeline, struct Field *currentField, struct Field *newField, long generation)
+{
+    unsigned int tracking = 0;
+    if (pipeline->pyramidEvery > 0 && generation % pipeline->pyramidEvery == 0)
+    {
+        tracking = TRACK_DENSITY;
+        allocateFieldDensities(newField);
+    }
+
+    currentField->tracking = (currentField->tracking & ~TRACK_DENSITY) | tracking;
+    newField->tracking = (newField->tracking & ~TRACK_DENSITY) | tracking;
+}
+
+// Queues the field if the generation is selected, blocks while all slots are in flight
+static inline void submitOutput(struct OutputPipeline *pipeline, struct Field *field, long generation)
+{
+    bool full = pipeline->every > 0 && generation % pipeline->every == 0;
+    bool pyramid = pipeline->pyramidEvery > 0 && generation % pipeline->pyramidEvery == 0;
+    if (!full && !pyramid)
+        return;
+
+    double start = omp_get_wtime();
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->availableCount == 0)
+        pthread_cond_wait(&pipeline->released, &pipeline->mutex);
+    int index = pipeline->available[--pipeline->availableCount];
+    pthread_mutex_unlock(&pipeline->mutex);
+    double copyStart = omp_get_wtime();
+    pipeline->stallTime += copyStart - start;
+
+    // The slot is owned by this thread until it is queued
+    struct OutputSlot *slot = &pipeline->slots[index];
+    slot->generation = generation;
+    slot->full = full;
+    slot->pyramid = pyramid;
+
+    if (full)
+    {
+        long cells = (long)field->width * field->height;
+        #pragma omp parallel for
+        for (long i = 0; i < cells; i += 1 << 16)
+        {
+            memcpy(slot->snapshot.field + i, field->field + i, MIN(1L << 16, cells - i) * sizeof(FieldType));
+        }
+    }
+    if (pyramid)
+        computeDensityPyramid(&slot->densities, field);
+    pipeline->copyTime += omp_get_wtime() - copyStart;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->queue[(pipeline->queueStart + pipeline->queueCount) % pipeline->depth] = index;
+    pipeline->queueCount++;
+    pthread_cond_signal(&pipeline->queued);
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+// Writes the remaining slots and stops the I/O threads
+static inline void finishOutputPipeline(struct OutputPipeline *pipeline)
+{
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->stopping = true;
+    pthread_cond_broadcast(&pipeline->queued);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    for (int i = 0; i < pipeline->threadCount; i++)
+    {
+        pthread_join(pipeline->threads[i], NULL);
+    }
+
+    for (int i = 0; i < pipeline->depth; i++)
+    {
+        if (pipeline->every > 0)
+            freeField(&pipeline->slots[i].snapshot);
+        if (pipeline->pyramidEvery > 0)
+            freeDensityPyramid(&pipeline->slots[i].densities);
+    }
+    free(pipeline->slots);
+    free(pipeline->available);
+    free(pipeline->queue);
+    free(pipeline->threads);
+
+    pthread_mutex_destroy(&pipeline->mutex);
+    pthread_cond_destroy(&pipeline->queued);
+    pthread_cond_destroy(&pipeline->released);
+}
+
+#endif // GOL_OUTPUT
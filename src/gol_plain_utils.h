@@ -3,20 +3,43 @@
 
 #include "gol_field.h"
 
+// Maps a coordinate onto the field according to the boundary mode, returns -1 if the cell is dead
+static inline int boundaryCoordinate(int c, int size, enum BoundaryMode boundary)
+{
+    if (c >= 0 && c < size)
+        return c;
+
+    switch (boundary)
+    {
+    case BOUNDARY_TORUS:
+        return (c + size) % size;
+    case BOUNDARY_REFLECT:
+        return c < 0 ? -c - 1 : 2 * size - c - 1;
+    default:
+        return -1;
+    }
+}
+
+// Boundary aware neighbor count, works for every cell but is only needed for the border
 static inline int countNeighbors(struct Field *currentField, int x, int y)
 {
     int sum = 0;
 
     for (int y1 = y - 1; y1 <= y + 1; y1++)
     {
+        int by = boundaryCoordinate(y1, currentField->height, currentField->boundary);
+        if (by < 0)
+            continue;
+
         for (int x1 = x - 1; x1 <= x + 1; x1++)
         {
-            sum += currentField->field[calcIndex(currentField->width,
-                                                 (x1 + currentField->width) % currentField->width,
-                                                 (y1 + currentField->height) % currentField->height)];
+            int bx = boundaryCoordinate(x1, currentField->width, currentField->boundary);
+            if (bx < 0 || (x1 == x && y1 == y))
+                continue;
+
+            sum += currentField->field[calcIndex(currentField->width, bx, by)];
         }
     }
-    sum -= currentField->field[calcIndex(currentField->width, x, y)];
     return sum;
 }
 
@@ -28,4 +51,491 @@ void golKernel(struct Field *currentField, struct Field *newField, int x, int y)
     newField->field[calcIndex(currentField->width, x, y)] = (n == 3 || (n == 2 && currentField->field[calcIndex(currentField->width, x, y)]));
 }
 
+//
+// Statistics (TRACK_*)
+//
+
+// Adds population, births and deaths of count cells that were just written to row, previousRow holds the same cells
+// one generation earlier. The 16 bit counters keep the loop vectorized, they are flushed every 65535 cells before
+// they overflow. Returns the population of the cells.
+static inline long countCells(const FieldType *previousRow, const FieldType *row, int count, struct FieldStatistics *statistics)
+{
+    long total = 0;
+    for (int blockX = 0; blockX < count; blockX += 65535)
+    {
+        int blockEndX = MIN(blockX + 65535, count);
+        unsigned short population = 0;
+        unsigned short previousPopulation = 0;
+        unsigned short survivors = 0;
+
+        for (int x = blockX; x < blockEndX; x++)
+        {
+            population += row[x];
+            previousPopulation += previousRow[x];
+            survivors += row[x] & previousRow[x];
+        }
+
+        statistics->births += population - survivors;
+        statistics->deaths += previousPopulation - survivors;
+        total += population;
+    }
+
+    statistics->population += total;
+    return total;
+}
+
+// Adds the live cells of row y in [startX, endX) to the bounding box. Only cells left of minX or right of maxX can
+// extend it, so once the box spans the region the row is not scanned at all. Zero words are skipped 8 cells at a time.
+static inline void trackBoundingBox(const FieldType *row, int startX, int endX, int y, struct FieldStatistics *statistics)
+{
+    statistics->minY = MIN(statistics->minY, y);
+    statistics->maxY = MAX(statistics->maxY, y);
+
+    uint64_t word;
+    int leftEnd = MIN(statistics->minX, endX);
+    int first = startX;
+    while (first + 8 <= leftEnd && (memcpy(&word, row + first, 8), word == 0))
+        first += 8;
+    while (first < leftEnd && !row[first])
+        first++;
+    if (first < leftEnd)
+        statistics->minX = first;
+
+    int rightEnd = MAX(statistics->maxX, startX - 1);
+    int last = endX - 1;
+    while (last - 8 >= rightEnd && (memcpy(&word, row + last - 7, 8), word == 0))
+        last -= 8;
+    while (last > rightEnd && !row[last])
+        last--;
+    if (last > rightEnd)
+        statistics->maxX = last;
+}
+
+// Accumulates the tracked statistics of the cells of row y in [startX, endX) that were just written
+static inline void trackCells(const FieldType *previousRow, const FieldType *row, int startX, int endX, int y, int width,
+                              unsigned int tracking, struct FieldStatistics *statistics)
+{
+    if (tracking & TRACK_HASH)
+        statistics->hash += hashCells(row + startX, endX - startX, calcIndex(width, startX, y));
+
+    if (tracking & TRACK_STATISTICS)
+    {
+        if (countCells(previousRow + startX, row + startX, endX - startX, statistics) > 0)
+            trackBoundingBox(row, startX, endX, y, statistics);
+    }
+}
+
+// Sums the complete TRACK_DENSITY blocks [startBx, endBx) of the block row whose first row is rows. The 4 words of a
+// block column are added first (column sums of at most 4 do not carry into the next byte), then the 4 bytes are added
+// in the top byte of a multiplication.
+static inline void sumDensityBlocks(const FieldType *rows, int width, int startBx, int endBx, uint32_t *sums)
+{
+    for (int bx = startBx; bx < endBx; bx++)
+    {
+        uint32_t column = 0;
+        for (int y = 0; y < DENSITY_BLOCK; y++)
+        {
+            uint32_t word;
+            memcpy(&word, rows + calcIndex(width, bx * DENSITY_BLOCK, y), sizeof(word));
+            column += word;
+        }
+        sums[bx] = (column * 0x01010101u) >> 24;
+    }
+}
+
+// Called after row y of the region [startX, endX) x [startY, endY) was written. After the last row of a block row
+// the blocks that lie completely inside the region are summed while the rows are still in L1. Only the thread writing
+// the region touches these blocks.
+static inline void trackDensityRow(struct Field *field, int startX, int endX, int startY, int endY, int y)
+{
+    int by = y / DENSITY_BLOCK;
+    if (y % DENSITY_BLOCK != DENSITY_BLOCK - 1 || by * DENSITY_BLOCK < startY)
+        return;
+
+    sumDensityBlocks(field->field + calcIndex(field->width, 0, by * DENSITY_BLOCK), field->width, densityBlocks(startX),
+                     endX / DENSITY_BLOCK, field->densities + calcIndex(densityBlocks(field->width), 0, by));
+}
+
+// Sums the TRACK_DENSITY blocks starting in the segment [startX, endX) x [startY, endY) that trackDensityRow left
+// out, i.e. the blocks not completely inside the region [regionStartX, regionEndX) x [regionStartY, regionEndY)
+// written for the segment. These reach over the seams, so all cells of the generation have to be written.
+static inline void completeDensityBlocks(struct Field *field, int startX, int endX, int startY, int endY, int regionStartX,
+                                         int regionEndX, int regionStartY, int regionEndY)
+{
+    for (int by = densityBlocks(startY); by < densityBlocks(endY); by++)
+    {
+        int y = by * DENSITY_BLOCK;
+        int rows = MIN(DENSITY_BLOCK, field->height - y);
+        bool rowInside = y >= regionStartY && y + DENSITY_BLOCK <= regionEndY;
+        const FieldType *blockRow = field->field + calcIndex(field->width, 0, y);
+        uint32_t *sums = field->densities + calcIndex(densityBlocks(field->width), 0, by);
+
+        int startBx = densityBlocks(startX);
+        int endBx = densityBlocks(endX);
+        if (!rowInside && rows == DENSITY_BLOCK)
+        {
+            // The whole block row is left, only a partial block at the right border needs the cell wise sum
+            int completeEndBx = MIN(endBx, field->width / DENSITY_BLOCK);
+            sumDensityBlocks(blockRow, field->width, startBx, completeEndBx, sums);
+            startBx = MAX(startBx, completeEndBx);
+        }
+
+        for (int bx = startBx; bx < endBx; bx++)
+        {
+            int x = bx * DENSITY_BLOCK;
+            if (rowInside && x >= regionStartX && x + DENSITY_BLOCK <= regionEndX)
+            {
+                // Continue with the first block reaching over the right edge of the region
+                bx = regionEndX / DENSITY_BLOCK - 1;
+                continue;
+            }
+
+            int columns = MIN(DENSITY_BLOCK, field->width - x);
+            if (rows == DENSITY_BLOCK && columns == DENSITY_BLOCK)
+            {
+                sumDensityBlocks(blockRow, field->width, bx, bx + 1, sums);
+                continue;
+            }
+
+            uint32_t sum = 0;
+            for (int y1 = 0; y1 < rows; y1++)
+            {
+                for (int x1 = x; x1 < x + columns; x1++)
+                    sum += blockRow[calcIndex(field->width, x1, y1)];
+            }
+            sums[bx] = sum;
+        }
+    }
+}
+
+//
+// Interior (no boundary checks)
+//
+
+// Requires 0 < y < height - 1 and 0 < startX <= endX < width
+static inline void golKernelInteriorRow(struct Field *currentField, struct Field *newField, int y, int startX, int endX)
+{
+    const int width = currentField->width;
+    const FieldType *above = currentField->field + calcIndex(width, 0, y - 1);
+    const FieldType *row = above + width;
+    const FieldType *below = row + width;
+    FieldType *out = newField->field + calcIndex(width, 0, y);
+
+    for (int x = startX; x < endX; x++)
+    {
+        FieldType n = above[x - 1] + above[x] + above[x + 1] +
+                row[x - 1] + row[x + 1] +
+                below[x - 1] + below[x] + below[x + 1];
+
+        out[x] = (n == 3) | ((n == 2) & row[x]);
+    }
+}
+
+// Neighbor count of column x from the rows above, at and below it, the columns outside of the field follow the
+// boundary mode
+static inline int countNeighborsRows(const FieldType *above, const FieldType *row, const FieldType *below, int x, int width,
+                                     enum BoundaryMode boundary)
+{
+    int sum = 0;
+    for (int x1 = x - 1; x1 <= x + 1; x1++)
+    {
+        int bx = boundaryCoordinate(x1, width, boundary);
+        if (bx < 0)
+            continue;
+
+        sum += above[bx] + below[bx] + (x1 != x ? row[bx] : 0);
+    }
+    return sum;
+}
+
+// Next generation of a row from the rows above, at and below it, which need not be adjacent in memory (zero rows, rows
+// saved by the in-place engine, boundary rows of a neighbor in an MPI shared window)
+static inline void golKernelRows(const FieldType *above, const FieldType *row, const FieldType *below, FieldType *out, int width,
+                                 enum BoundaryMode boundary)
+{
+    for (int x = 1; x < width - 1; x++)
+    {
+        FieldType n = above[x - 1] + above[x] + above[x + 1] +
+                row[x - 1] + row[x + 1] +
+                below[x - 1] + below[x] + below[x + 1];
+
+        out[x] = (n == 3) | ((n == 2) & row[x]);
+    }
+
+    // First and last column, the same column if the field is a single cell wide
+    for (int x = 0; x < width; x += MAX(width - 1, 1))
+    {
+        int n = countNeighborsRows(above, row, below, x, width, boundary);
+        out[x] = n == 3 || (n == 2 && row[x]);
+    }
+}
+
+// Cells of the statistics kernel as GCC / Clang vector: the counters stay bytes in registers, which the vectorizer
+// cannot do for scalar code (it widens every counter to 16 bit)
+#if defined(__AVX512BW__)
+#define CELL_VECTOR_BYTES 64
+#elif defined(__AVX2__)
+#define CELL_VECTOR_BYTES 32
+#else
+#define CELL_VECTOR_BYTES 16
+#endif
+
+typedef FieldType CellVector __attribute__((vector_size(CELL_VECTOR_BYTES)));
+typedef uint64_t CellVectorWords __attribute__((vector_size(CELL_VECTOR_BYTES)));
+
+static inline CellVector loadCellVector(const FieldType *cells)
+{
+    CellVector vector;
+    memcpy(&vector, cells, sizeof(vector));
+    return vector;
+}
+
+// Sum of all byte lanes: 8 bytes -> 4 x 16 bit -> sum in the top 16 bit of every word
+static inline long sumCellVector(CellVector vector)
+{
+    CellVectorWords words = (CellVectorWords)vector;
+    long sum = 0;
+    for (int i = 0; i < CELL_VECTOR_BYTES / 8; i++)
+    {
+        uint64_t pairs = (words[i] & 0x00ff00ff00ff00ffULL) + (words[i] >> 8 & 0x00ff00ff00ff00ffULL);
+        sum += (pairs * 0x0001000100010001ULL) >> 48;
+    }
+    return sum;
+}
+
+// Next generation (0 / 1 per lane) of the CELL_VECTOR_BYTES cells at x of row
+static inline CellVector golKernelCellVector(const FieldType *above, const FieldType *row, const FieldType *below, int x)
+{
+    CellVector n = loadCellVector(above + x - 1) + loadCellVector(above + x) + loadCellVector(above + x + 1) +
+                   loadCellVector(row + x - 1) + loadCellVector(row + x + 1) +
+                   loadCellVector(below + x - 1) + loadCellVector(below + x) + loadCellVector(below + x + 1);
+
+    // Either 3 neighbors or 2 neighbors and alive, i.e. n | cell == 3 (comparisons yield -1 per lane)
+    return -(CellVector)((n | loadCellVector(row + x)) == 3);
+}
+
+// hashMix of every 64 bit lane
+static inline CellVectorWords hashMixVector(CellVectorWords value)
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+static const FieldType cellVectorLanes[64] = {0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
+                                              16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+                                              32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+                                              48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63};
+
+// Same as golKernelInteriorRow, additionally accumulates the hash (same words as hashCells) and counts population,
+// births and deaths in the same loop. Every lane of the byte counters counts one column of the vectors, they are summed
+// after blocks of at most 254 full vectors and the partial last vector, so no lane is added to more than 255 times.
+// Returns the population of the written cells (0 without TRACK_STATISTICS).
+static inline long golKernelInteriorRowTracked(struct Field *currentField, struct Field *newField, int y, int startX, int endX,
+                                               unsigned int tracking, struct FieldStatistics *statistics)
+{
+    const int width = currentField->width;
+    const FieldType *above = currentField->field + calcIndex(width, 0, y - 1);
+    const FieldType *row = above + width;
+    const FieldType *below = row + width;
+    FieldType *out = newField->field + calcIndex(width, 0, y);
+
+    if (endX - startX < CELL_VECTOR_BYTES)
+    {
+        golKernelInteriorRow(currentField, newField, y, startX, endX);
+        if (tracking & TRACK_HASH)
+            statistics->hash += hashCells(out + startX, endX - startX, calcIndex(width, startX, y));
+        return (tracking & TRACK_STATISTICS) ? countCells(row + startX, out + startX, endX - startX, statistics) : 0;
+    }
+
+    long population = 0;
+    long previousPopulation = 0;
+    long survivors = 0;
+
+    // Position keys of the words of the next vector, see hashCells
+    CellVectorWords hashLanes = {0};
+    CellVectorWords keys;
+    for (int i = 0; i < CELL_VECTOR_BYTES / 8; i++)
+        keys[i] = (calcIndex(width, startX, y) + 8ULL * i) * 0x9e3779b97f4a7c15ULL;
+
+    int x = startX;
+    while (x < endX)
+    {
+        CellVector populationLanes = {0};
+        CellVector previousLanes = {0};
+        CellVector survivorLanes = {0};
+
+        int blockEndX = MIN(x + 254 * CELL_VECTOR_BYTES, endX - CELL_VECTOR_BYTES + 1);
+        for (; x < blockEndX; x += CELL_VECTOR_BYTES)
+        {
+            CellVector cells = loadCellVector(row + x);
+            CellVector alive = golKernelCellVector(above, row, below, x);
+            memcpy(out + x, &alive, sizeof(alive));
+
+            if (tracking & TRACK_HASH)
+            {
+                hashLanes += hashMixVector((CellVectorWords)alive ^ keys);
+                keys += (uint64_t)CELL_VECTOR_BYTES * 0x9e3779b97f4a7c15ULL;
+            }
+            if (tracking & TRACK_STATISTICS)
+            {
+                populationLanes += alive;
+                previousLanes += cells;
+                survivorLanes += alive & cells;
+            }
+        }
+
+        // Partial last vector: recomputed overlapping the previous one (same results), only the new lanes are counted
+        if (x < endX && blockEndX == endX - CELL_VECTOR_BYTES + 1)
+        {
+            int lastX = endX - CELL_VECTOR_BYTES;
+            CellVector counted = (CellVector)(loadCellVector(cellVectorLanes) >= (FieldType)(x - lastX));
+            CellVector cells = loadCellVector(row + lastX) & counted;
+            CellVector alive = golKernelCellVector(above, row, below, lastX);
+            memcpy(out + lastX, &alive, sizeof(alive));
+
+            if (tracking & TRACK_HASH)
+                statistics->hash += hashCells(out + x, endX - x, calcIndex(width, x, y));
+
+            alive &= counted;
+            populationLanes += alive;
+            previousLanes += cells;
+            survivorLanes += alive & cells;
+            x = endX;
+        }
+
+        if (tracking & TRACK_STATISTICS)
+        {
+            population += sumCellVector(populationLanes);
+            previousPopulation += sumCellVector(previousLanes);
+            survivors += sumCellVector(survivorLanes);
+        }
+    }
+
+    for (int i = 0; i < CELL_VECTOR_BYTES / 8; i++)
+        statistics->hash += hashLanes[i];
+
+    statistics->population += population;
+    statistics->births += population - survivors;
+    statistics->deaths += previousPopulation - survivors;
+    return population;
+}
+
+// Computes the part of the region that does not touch the border of the field.
+// statistics (may be NULL) accumulates the tracked statistics of the written cells while they are still in registers.
+static inline void golKernelInteriorRegion(struct Field *currentField, struct Field *newField, int startX, int endX, int startY, int endY,
+                                           struct FieldStatistics *statistics)
+{
+    startX = MAX(startX, 1);
+    startY = MAX(startY, 1);
+    endX = MIN(endX, currentField->width - 1);
+    endY = MIN(endY, currentField->height - 1);
+
+    unsigned int tracking = statistics != NULL ? currentField->tracking : 0;
+    for (int y = startY; y < endY; y++)
+    {
+        if (tracking == 0 || endX <= startX)
+        {
+            golKernelInteriorRow(currentField, newField, y, startX, endX);
+            continue;
+        }
+
+        // Constant tracking, so every combination gets its own loop without the branches
+        long population = 0;
+        switch (tracking & (TRACK_HASH | TRACK_STATISTICS))
+        {
+        case 0:
+            golKernelInteriorRow(currentField, newField, y, startX, endX);
+            break;
+        case TRACK_HASH:
+            population = golKernelInteriorRowTracked(currentField, newField, y, startX, endX, TRACK_HASH, statistics);
+            break;
+        case TRACK_STATISTICS:
+            population = golKernelInteriorRowTracked(currentField, newField, y, startX, endX, TRACK_STATISTICS, statistics);
+            break;
+        default:
+            population = golKernelInteriorRowTracked(currentField, newField, y, startX, endX, TRACK_HASH | TRACK_STATISTICS, statistics);
+            break;
+        }
+
+        if (population > 0)
+            trackBoundingBox(newField->field + calcIndex(currentField->width, 0, y), startX, endX, y, statistics);
+
+        // The row was just written and is still in L1
+        if (tracking & TRACK_DENSITY)
+            trackDensityRow(newField, startX, endX, startY, endY, y);
+    }
+}
+
+// completeDensityBlocks for a segment whose interior was computed by golKernelInteriorRegion
+static inline void completeDensitySegment(struct Field *field, int startX, int endX, int startY, int endY)
+{
+    completeDensityBlocks(field, startX, endX, startY, endY, MAX(startX, 1), MIN(endX, field->width - 1), MAX(startY, 1),
+                          MIN(endY, field->height - 1));
+}
+
+//
+// Border (boundary mode aware)
+//
+
+// Number of cells in the outermost frame of the field
+static inline int borderCellCount(struct Field *currentField)
+{
+    if (currentField->width <= 2 || currentField->height <= 2)
+        return currentField->width * currentField->height;
+
+    return 2 * currentField->width + 2 * (currentField->height - 2);
+}
+
+// Maps i in [0, borderCellCount) onto the frame: top row, bottom row, then left and right column alternating
+static inline void borderCellCoordinates(struct Field *currentField, int i, int *x, int *y)
+{
+    int width = currentField->width;
+    if (width <= 2 || currentField->height <= 2)
+    {
+        *x = i % width;
+        *y = i / width;
+        return;
+    }
+
+    if (i < 2 * width)
+    {
+        *x = i % width;
+        *y = i < width ? 0 : currentField->height - 1;
+        return;
+    }
+
+    i -= 2 * width;
+    *x = (i & 1) ? width - 1 : 0;
+    *y = 1 + i / 2;
+}
+
+static inline void golKernelBorderCell(struct Field *currentField, struct Field *newField, int i, struct FieldStatistics *statistics)
+{
+    int x, y;
+    borderCellCoordinates(currentField, i, &x, &y);
+    golKernel(currentField, newField, x, y);
+
+    if (statistics == NULL)
+        return;
+
+    // Single cell, without the setup of the row loops of trackCells
+    int index = calcIndex(currentField->width, x, y);
+    FieldType alive = newField->field[index];
+    FieldType previous = currentField->field[index];
+    if (currentField->tracking & TRACK_HASH)
+        statistics->hash += hashMix(alive ^ (index * 0x9e3779b97f4a7c15ULL));
+    if (currentField->tracking & TRACK_STATISTICS)
+    {
+        statistics->population += alive;
+        statistics->births += alive & !previous;
+        statistics->deaths += previous & !alive;
+        if (alive)
+            extendFieldStatistics(statistics, x, y);
+    }
+}
+
 #endif // GOL_PLAIN_UTILS
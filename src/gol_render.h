@@ -0,0 +1,311 @@
+#ifndef GOL_RENDER
+#define GOL_RENDER
+
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#include "gol_field.h"
+#include "gol_affinity.h"
+
+//
+// Terminal Renderer
+//
+// Live view of a running simulation. A render thread asks for a new frame at most fps times per second; the
+// simulation copies the field into the renderer's snapshot only when a frame was asked for and continues without
+// waiting for the terminal. The snapshot is downsampled to the terminal size (a glyph shows 2 x 4 dots in braille
+// mode and 1 x 2 in half block mode, a dot is set if any cell of its block is alive). A frame is built in one buffer
+// that only contains the glyphs that changed since the previous frame and is written with a single write().
+//
+
+enum RenderMode
+{
+    RENDER_BRAILLE,    // U+2800 braille patterns, 2 x 4 dots per glyph
+    RENDER_HALF_BLOCK, // upper / lower half blocks, 1 x 2 dots per glyph
+};
+
+#define RENDER_UNDRAWN 0xffff // previous glyph that never matches, forces a redraw
+
+struct TerminalRenderer
+{
+    enum RenderMode mode;
+    int dotsX; // dots per glyph
+    int dotsY;
+
+    int columns; // glyphs, the last terminal line is the status line
+    int rows;
+    int scale; // cells per dot in both directions
+
+    unsigned short *glyphs; // columns * rows dot masks of the previous frame
+    char *frame;
+    size_t frameCapacity;
+
+    struct Field snapshot;
+    long generation; // generation in snapshot
+
+    double interval; // seconds between frames
+    long frames;
+    long dirtyGlyphs; // glyphs written over all frames
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    int wanted; // the render thread waits for a snapshot, read without the mutex by the simulation
+    bool ready;
+    bool stopping;
+};
+
+static inline unsigned short renderDotBit(enum RenderMode mode, int dotX, int dotY)
+{
+    if (mode == RENDER_HALF_BLOCK)
+        return 1 << dotY;
+
+    // Braille numbering: dots 1-3 and 4-6 are the upper three rows of the columns, 7 and 8 the last row
+    static const unsigned short bits[4][2] = {{0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}};
+    return bits[dotY][dotX];
+}
+
+// Appends the UTF-8 glyph of a dot mask, returns the number of bytes
+static inline int renderGlyph(enum RenderMode mode, unsigned short mask, char *out)
+{
+    if (mode == RENDER_HALF_BLOCK)
+    {
+        static const char *blocks[4] = {" ", "\xe2\x96\x80", "\xe2\x96\x84", "\xe2\x96\x88"};
+        int length = strlen(blocks[mask]);
+        memcpy(out, blocks[mask], length);
+        return length;
+    }
+
+    int codepoint = 0x2800 + mask;
+    out[0] = 0xe0 | (codepoint >> 12);
+    out[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+    out[2] = 0x80 | (codepoint & 0x3f);
+    return 3;
+}
+
+// Dot masks of the snapshot, a dot is set if any cell of its scale x scale block is alive
+static inline void renderDownsample(struct TerminalRenderer *renderer, unsigned short *glyphs)
+{
+    struct Field *field = &renderer->snapshot;
+    memset(glyphs, 0, (size_t)renderer->columns * renderer->rows * sizeof(unsigned short));
+
+    int dotsWidth = renderer->columns * renderer->dotsX;
+    int dotsHeight = renderer->rows * renderer->dotsY;
+    for (int y = 0; y < field->height; y++)
+    {
+        int dotY = y / renderer->scale;
+        if (dotY >= dotsHeight)
+            break;
+
+        const FieldType *row = field->field + calcIndex(field->width, 0, y);
+        unsigned short *glyphRow = glyphs + (size_t)(dotY / renderer->dotsY) * renderer->columns;
+        for (int x = 0; x < field->width; x++)
+        {
+            if (!row[x])
+                continue;
+
+            int dotX = x / renderer->scale;
+            if (dotX >= dotsWidth)
+                break;
+            glyphRow[dotX / renderer->dotsX] |= renderDotBit(renderer->mode, dotX % renderer->dotsX, dotY % renderer->dotsY);
+        }
+    }
+}
+
+static inline void reserveRenderFrame(struct TerminalRenderer *renderer, size_t bytes)
+{
+    if (bytes <= renderer->frameCapacity)
+        return;
+    renderer->frameCapacity = MAX(bytes, 2 * renderer->frameCapacity);
+    renderer->frame = (char *)realloc(renderer->frame, renderer->frameCapacity);
+}
+
+// Builds the frame from the snapshot and writes it, only changed glyphs are emitted
+static inline void renderFrame(struct TerminalRenderer *renderer, unsigned short *glyphs)
+{
+    renderDownsample(renderer, glyphs);
+
+    // Worst case: cursor movement and a glyph for every cell plus the status line
+    reserveRenderFrame(renderer, (size_t)renderer->columns * renderer->rows * 16 + 256);
+    char *out = renderer->frame;
+
+    for (int y = 0; y < renderer->rows; y++)
+    {
+        int cursor = -1; // column the cursor is at, -1 if unknown
+        for (int x = 0; x < renderer->columns; x++)
+        {
+            int i = y * renderer->columns + x;
+            if (glyphs[i] == renderer->glyphs[i])
+                continue;
+
+            if (cursor != x)
+                out += sprintf(out, "\033[%d;%dH", y + 1, x + 1);
+            out += renderGlyph(renderer->mode, glyphs[i], out);
+            cursor = x + 1;
+
+            renderer->glyphs[i] = glyphs[i];
+            renderer->dirtyGlyphs++;
+        }
+    }
+
+    out += sprintf(out, "\033[%d;1H\033[Kgeneration %ld  %dx%d cells per dot  %ldx%ld board", renderer->rows + 1,
+                   renderer->generation, renderer->scale, renderer->scale, (long)renderer->snapshot.width,
+                   (long)renderer->snapshot.height);
+
+    size_t length = out - renderer->frame;
+    for (size_t written = 0; written < length;)
+    {
+        ssize_t result = write(STDOUT_FILENO, renderer->frame + written, length - written);
+        if (result <= 0)
+            break;
+        written += result;
+    }
+    renderer->frames++;
+}
+
+static void *runRenderThread(void *argument)
+{
+    struct TerminalRenderer *renderer = (struct TerminalRenderer *)argument;
+    unpinThread();
+    unsigned short *glyphs = (unsigned short *)malloc((size_t)renderer->columns * renderer->rows * sizeof(unsigned short));
+
+    pthread_mutex_lock(&renderer->mutex);
+    while (!renderer->stopping)
+    {
+        double start = omp_get_wtime();
+        __atomic_store_n(&renderer->wanted, 1, __ATOMIC_RELEASE);
+        while (!renderer->ready && !renderer->stopping)
+            pthread_cond_wait(&renderer->changed, &renderer->mutex);
+
+        // The snapshot belongs to this thread until the next frame is wanted
+        if (renderer->ready)
+        {
+            renderer->ready = false;
+            pthread_mutex_unlock(&renderer->mutex);
+            renderFrame(renderer, glyphs);
+            pthread_mutex_lock(&renderer->mutex);
+        }
+
+        // Frame rate cap
+        double remaining = renderer->interval - (omp_get_wtime() - start);
+        if (remaining > 0 && !renderer->stopping)
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            long nanoseconds = deadline.tv_nsec + (long)(remaining * 1e9);
+            deadline.tv_sec += nanoseconds / 1000000000L;
+            deadline.tv_nsec = nanoseconds % 1000000000L;
+            pthread_cond_timedwait(&renderer->changed, &renderer->mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&renderer->mutex);
+
+    free(glyphs);
+    return NULL;
+}
+
+// Terminal size without the status line, 80 x 23 if stdout is no terminal
+static inline void terminalSize(int *columns, int *rows)
+{
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 1)
+    {
+        *columns = size.ws_col;
+        *rows = size.ws_row - 1;
+        return;
+    }
+    *columns = 80;
+    *rows = 23;
+}
+
+// Starts the render thread, glyphs are fitted to the terminal (columns / rows <= 0) or to the given size
+static inline void initializeTerminalRenderer(struct TerminalRenderer *renderer, struct Field *field, enum RenderMode mode, double fps,
+                                              int columns, int rows)
+{
+    renderer->mode = mode;
+    renderer->dotsX = mode == RENDER_BRAILLE ? 2 : 1;
+    renderer->dotsY = mode == RENDER_BRAILLE ? 4 : 2;
+
+    if (columns <= 0 || rows <= 0)
+        terminalSize(&columns, &rows);
+
+    // Same scale in both directions to keep the aspect ratio, the glyph grid shrinks to the board
+    int scaleX = (field->width + columns * renderer->dotsX - 1) / (columns * renderer->dotsX);
+    int scaleY = (field->height + rows * renderer->dotsY - 1) / (rows * renderer->dotsY);
+    renderer->scale = MAX(1, MAX(scaleX, scaleY));
+    int dotsWidth = (field->width + renderer->scale - 1) / renderer->scale;
+    int dotsHeight = (field->height + renderer->scale - 1) / renderer->scale;
+    renderer->columns = MIN(columns, (dotsWidth + renderer->dotsX - 1) / renderer->dotsX);
+    renderer->rows = MIN(rows, (dotsHeight + renderer->dotsY - 1) / renderer->dotsY);
+
+    size_t glyphCount = (size_t)renderer->columns * renderer->rows;
+    renderer->glyphs = (unsigned short *)malloc(glyphCount * sizeof(unsigned short));
+    for (size_t i = 0; i < glyphCount; i++)
+        renderer->glyphs[i] = RENDER_UNDRAWN;
+    renderer->frame = NULL;
+    renderer->frameCapacity = 0;
+
+    initializeFieldOther(&renderer->snapshot, field);
+    renderer->generation = 0;
+
+    renderer->interval = 1.0 / (fps > 0 ? fps : 30);
+    renderer->frames = 0;
+    renderer->dirtyGlyphs = 0;
+
+    renderer->wanted = 0;
+    renderer->ready = false;
+    renderer->stopping = false;
+    pthread_mutex_init(&renderer->mutex, NULL);
+    pthread_cond_init(&renderer->changed, NULL);
+
+    // Clear the screen and hide the cursor
+    printf("\033[2J\033[?25l");
+    fflush(stdout);
+
+    pthread_create(&renderer->thread, NULL, runRenderThread, renderer);
+}
+
+// Hands the field to the render thread if it waits for a frame, otherwise returns immediately
+static inline void offerRenderFrame(struct TerminalRenderer *renderer, struct Field *field, long generation)
+{
+    if (!__atomic_load_n(&renderer->wanted, __ATOMIC_ACQUIRE))
+        return;
+    __atomic_store_n(&renderer->wanted, 0, __ATOMIC_RELAXED);
+
+    memcpy(renderer->snapshot.field, field->field, (size_t)field->width * field->height * sizeof(FieldType));
+    renderer->generation = generation;
+
+    pthread_mutex_lock(&renderer->mutex);
+    renderer->ready = true;
+    pthread_cond_signal(&renderer->changed);
+    pthread_mutex_unlock(&renderer->mutex);
+}
+
+// Renders the field as last frame and stops the render thread
+static inline void finishTerminalRenderer(struct TerminalRenderer *renderer, struct Field *field, long generation)
+{
+    pthread_mutex_lock(&renderer->mutex);
+    renderer->stopping = true;
+    pthread_cond_signal(&renderer->changed);
+    pthread_mutex_unlock(&renderer->mutex);
+    pthread_join(renderer->thread, NULL);
+
+    // The render thread is gone, the final frame is drawn on this thread
+    memcpy(renderer->snapshot.field, field->field, (size_t)field->width * field->height * sizeof(FieldType));
+    renderer->generation = generation;
+    unsigned short *glyphs = (unsigned short *)malloc((size_t)renderer->columns * renderer->rows * sizeof(unsigned short));
+    renderFrame(renderer, glyphs);
+    free(glyphs);
+
+    // Show the cursor again below the status line
+    printf("\033[?25h\n");
+    fflush(stdout);
+
+    freeField(&renderer->snapshot);
+    free(renderer->glyphs);
+    free(renderer->frame);
+    pthread_mutex_destroy(&renderer->mutex);
+    pthread_cond_destroy(&renderer->changed);
+}
+
+#endif // GOL_RENDER
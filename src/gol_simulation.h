@@ -0,0 +1,157 @@
+#ifndef GOL_SIMULATION
+#define GOL_SIMULATION
+
+#include "gol_field.h"
+#include "gol_plain_utils.h"
+#include "gol_cycle.h"
+#include "gol_output.h"
+#include "gol_render.h"
+
+//
+// Simulation Loop
+//
+
+// Optional observers of simulateSteps, every member may be NULL
+struct SimulationMonitor
+{
+    long generation; // generation of the current field, advanced by simulateSteps
+
+    struct CycleDetector *detector; // stop once the board is periodic (requires TRACK_HASH)
+    FILE *statistics;               // CSV stream of the per generation statistics (requires TRACK_STATISTICS)
+    struct OutputPipeline *output;  // VTK output of every n-th generation
+    struct TerminalRenderer *renderer; // live view, only copies a generation when the render thread wants a frame
+
+    bool verify;     // recount the statistics of every generation in a separate pass (requires TRACK_STATISTICS)
+    long mismatches; // generations whose tracked statistics differ from the recount
+};
+
+static inline void initializeSimulationMonitor(struct SimulationMonitor *monitor)
+{
+    memset(monitor, 0, sizeof(*monitor));
+}
+
+static inline void writeStatisticsHeader(FILE *file)
+{
+    fprintf(file, "generation,population,births,deaths,min_x,min_y,max_x,max_y\n");
+}
+
+static inline void writeStatisticsRow(FILE *file, long generation, struct FieldStatistics *statistics)
+{
+    fprintf(file, "%ld,%ld,%ld,%ld,%d,%d,%d,%d\n", generation,
+            statistics->population, statistics->births, statistics->deaths,
+            statistics->minX, statistics->minY, statistics->maxX, statistics->maxY);
+}
+
+// Called before every step
+static inline void prepareGeneration(struct SimulationMonitor *monitor, struct Field *currentField, struct Field *newField)
+{
+    if (monitor->output != NULL)
+        prepareOutput(monitor->output, currentField, newField, monitor->generation + 1);
+}
+
+// Compares the statistics the engine tracked while writing currentField with a scalar recount against previousField
+static inline bool verifyFieldStatistics(struct Field *previousField, struct Field *currentField)
+{
+    struct FieldStatistics expected;
+    computeFieldStatistics(currentField, &expected);
+
+    struct FieldStatistics changes;
+    initializeFieldStatistics(&changes);
+    for (int y = 0; y < currentField->height; y++)
+    {
+        long index = calcIndex(currentField->width, 0, y);
+        countCells(previousField->field + index, currentField->field + index, currentField->width, &changes);
+    }
+
+    struct FieldStatistics *tracked = &currentField->statistics;
+    return tracked->population == expected.population && tracked->births == changes.births && tracked->deaths == changes.deaths &&
+           tracked->minX == expected.minX && tracked->minY == expected.minY && tracked->maxX == expected.maxX &&
+           tracked->maxY == expected.maxY;
+}
+
+// Called for every generation the engine produced, previousField holds the generation before (the same field in place)
+static inline void observeGeneration(struct SimulationMonitor *monitor, struct Field *currentField, struct Field *previousField)
+{
+    if (monitor->verify && previousField != currentField && !verifyFieldStatistics(previousField, currentField))
+    {
+        fprintf(stderr, "Statistics of generation %ld differ from the recount\n", monitor->generation);
+        monitor->mismatches++;
+    }
+    if (monitor->statistics != NULL)
+        writeStatisticsRow(monitor->statistics, monitor->generation, &currentField->statistics);
+    if (monitor->output != NULL)
+        submitOutput(monitor->output, currentField, monitor->generation);
+    if (monitor->renderer != NULL)
+        offerRenderFrame(monitor->renderer, currentField, monitor->generation);
+}
+
+// Returns the field holding the final generation. With a cycle detector the simulation stops as soon as the board is
+// periodic and only fast-forwards the remaining steps modulo the period.
+struct Field *simulateSteps(int timesteps, struct Field *currentField, struct Field *newField, simulate_func simulateFunction,
+                            struct SimulationMonitor *monitor)
+{
+    struct SimulationMonitor noMonitor;
+    if (monitor == NULL)
+    {
+        initializeSimulationMonitor(&noMonitor);
+        monitor = &noMonitor;
+    }
+
+    if (monitor->statistics != NULL && monitor->generation == 0)
+    {
+        struct FieldStatistics initial;
+        computeFieldStatistics(currentField, &initial);
+        writeStatisticsHeader(monitor->statistics);
+        writeStatisticsRow(monitor->statistics, 0, &initial);
+    }
+    if (monitor->output != NULL && monitor->generation == 0)
+        submitOutput(monitor->output, currentField, 0);
+
+    long startGeneration = monitor->generation;
+    long t;
+    for (t = 0; t < timesteps; t++)
+    {
+        prepareGeneration(monitor, currentField, newField);
+        simulateFunction(currentField, newField, monitor->generation);
+
+#ifdef DEBUG
+        printf("Timestep: %ld\n", t);
+        printField(newField);
+        usleep(200000);
+#endif
+
+        // SWAP
+        struct Field *temp = currentField;
+        currentField = newField;
+        newField = temp;
+
+        monitor->generation++;
+        observeGeneration(monitor, currentField, newField);
+
+        if (monitor->detector != NULL && recordCycleDetector(monitor->detector, monitor->generation, currentField->statistics.hash))
+        {
+            // Generation timesteps equals generation t + 1 + (timesteps - t - 1) % period
+            long remaining = (timesteps - t - 1) % monitor->detector->period;
+            for (long r = 0; r < remaining; r++)
+            {
+                prepareGeneration(monitor, currentField, newField);
+                simulateFunction(currentField, newField, monitor->generation);
+
+                temp = currentField;
+                currentField = newField;
+                newField = temp;
+
+                monitor->generation++;
+                observeGeneration(monitor, currentField, newField);
+            }
+
+            // The current field is equivalent to the requested generation
+            monitor->generation = startGeneration + timesteps;
+            break;
+        }
+    }
+
+    return currentField;
+}
+
+#endif // GOL_SIMULATION
@@ -0,0 +1,442 @@
+#ifndef GOL_SPARSE
+#define GOL_SPARSE
+
+#include "gol_field.h"
+#include "gol_plain_utils.h"
+
+// Switch from a dense to the sparse representation below this population density
+// (one sparse live cell costs about as much as 200 dense cells)
+#define SPARSE_DENSITY_ENTER 0.0025
+// Switch back to the dense representation above this population density (hysteresis)
+#define SPARSE_DENSITY_LEAVE 0.005
+// Dense steps between two population counts
+#define SPARSE_CHECK_INTERVAL 16
+
+//
+// Sparse Field
+//
+// Only live cells are stored as a sorted coordinate list in compressed row format:
+// the live cells of row rows[i] are xs[rowOffsets[i]] ... xs[rowOffsets[i + 1] - 1] (ascending).
+//
+
+struct SparseField
+{
+    int width;
+    int height;
+    enum BoundaryMode boundary;
+
+    long population;
+    int rowCount;
+
+    int *rows;
+    long *rowOffsets;
+    int *xs;
+
+    int rowCapacity;
+    long cellCapacity;
+};
+
+static inline void initializeSparseField(struct SparseField *field, int width, int height, enum BoundaryMode boundary)
+{
+    field->width = width;
+    field->height = height;
+    field->boundary = boundary;
+
+    field->population = 0;
+    field->rowCount = 0;
+
+    field->rowCapacity = 0;
+    field->cellCapacity = 0;
+    field->rows = NULL;
+    field->xs = NULL;
+    field->rowOffsets = (long *)calloc(1, sizeof(long));
+}
+
+static inline void freeSparseField(struct SparseField *field)
+{
+    free(field->rows);
+    free(field->rowOffsets);
+    free(field->xs);
+}
+
+static inline void reserveSparseField(struct SparseField *field, int rowCount, long population)
+{
+    if (rowCount > field->rowCapacity)
+    {
+        field->rowCapacity = MAX(rowCount, 2 * field->rowCapacity);
+        field->rows = (int *)realloc(field->rows, field->rowCapacity * sizeof(int));
+        field->rowOffsets = (long *)realloc(field->rowOffsets, (field->rowCapacity + 1) * sizeof(long));
+    }
+    if (population > field->cellCapacity)
+    {
+        field->cellCapacity = MAX(population, 2 * field->cellCapacity);
+        field->xs = (int *)realloc(field->xs, field->cellCapacity * sizeof(int));
+    }
+}
+
+// Returns the index of row y in field->rows or -1 if the row has no live cells
+static inline int findSparseRow(struct SparseField *field, int y)
+{
+    int low = 0;
+    int high = field->rowCount - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        if (field->rows[middle] < y)
+            low = middle + 1;
+        else if (field->rows[middle] > y)
+            high = middle - 1;
+        else
+            return middle;
+    }
+    return -1;
+}
+
+static int compareInt(const void *a, const void *b)
+{
+    int left = *(const int *)a;
+    int right = *(const int *)b;
+    return (left > right) - (left < right);
+}
+
+//
+// Conversion
+//
+
+static inline void sparseFromField(struct SparseField *sparse, struct Field *dense)
+{
+    int width = dense->width;
+    int height = dense->height;
+    sparse->width = width;
+    sparse->height = height;
+    sparse->boundary = dense->boundary;
+
+    long *counts = (long *)malloc((height + 1) * sizeof(long));
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+        long count = 0;
+        const FieldType *row = dense->field + calcIndex(width, 0, y);
+        for (int x = 0; x < width; x++)
+            count += row[x];
+        counts[y] = count;
+    }
+
+    // Prefix sum over the non empty rows
+    int rowCount = 0;
+    long population = 0;
+    for (int y = 0; y < height; y++)
+    {
+        rowCount += counts[y] > 0;
+        population += counts[y];
+    }
+    reserveSparseField(sparse, rowCount, population);
+
+    int i = 0;
+    long offset = 0;
+    for (int y = 0; y < height; y++)
+    {
+        if (counts[y] == 0)
+            continue;
+
+        sparse->rows[i] = y;
+        sparse->rowOffsets[i] = offset;
+        offset += counts[y];
+        i++;
+    }
+    sparse->rowOffsets[rowCount] = population;
+    sparse->rowCount = rowCount;
+    sparse->population = population;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int r = 0; r < rowCount; r++)
+    {
+        const FieldType *row = dense->field + calcIndex(width, 0, sparse->rows[r]);
+        int *xs = sparse->xs + sparse->rowOffsets[r];
+        for (int x = 0; x < width; x++)
+        {
+            if (row[x])
+                *xs++ = x;
+        }
+    }
+
+    free(counts);
+}
+
+static inline void sparseToField(struct SparseField *sparse, struct Field *dense)
+{
+    int width = dense->width;
+
+    #pragma omp parallel
+    {
+        #pragma omp for
+        for (int y = 0; y < dense->height; y++)
+        {
+            memset(dense->field + calcIndex(width, 0, y), 0, width * sizeof(FieldType));
+        }
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int r = 0; r < sparse->rowCount; r++)
+        {
+            FieldType *row = dense->field + calcIndex(width, 0, sparse->rows[r]);
+            for (long i = sparse->rowOffsets[r]; i < sparse->rowOffsets[r + 1]; i++)
+                row[sparse->xs[i]] = 1;
+        }
+    }
+}
+
+//
+// Simulation
+//
+
+// Column scratch flags, the lowest two bits count the live cells of the three rows in this column
+#define SPARSE_COLUMN_COUNT 0x03
+#define SPARSE_COLUMN_CENTER 0x04
+#define SPARSE_COLUMN_VISITED 0x08
+
+// Returns the live cells of a row (NULL and length 0 if the row is empty or outside of the field)
+static inline int *sparseRowCells(struct SparseField *field, int row, long *length)
+{
+    int r = row < 0 ? -1 : findSparseRow(field, row);
+    if (r < 0)
+    {
+        *length = 0;
+        return NULL;
+    }
+
+    *length = field->rowOffsets[r + 1] - field->rowOffsets[r];
+    return field->xs + field->rowOffsets[r];
+}
+
+static inline void simulateStepSparse(struct SparseField *currentField, struct SparseField *newField)
+{
+    int width = currentField->width;
+    int height = currentField->height;
+    enum BoundaryMode boundary = currentField->boundary;
+    newField->width = width;
+    newField->height = height;
+    newField->boundary = boundary;
+
+    // Candidate rows: every row next to a live row
+    int *candidates = (int *)malloc((3 * currentField->rowCount + 1) * sizeof(int));
+    int candidateCount = 0;
+    for (int r = 0; r < currentField->rowCount; r++)
+    {
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            int y = boundaryCoordinate(currentField->rows[r] + dy, height, boundary);
+            if (y >= 0)
+                candidates[candidateCount++] = y;
+        }
+    }
+    qsort(candidates, candidateCount, sizeof(int), compareInt);
+    int unique = 0;
+    for (int i = 0; i < candidateCount; i++)
+    {
+        if (unique == 0 || candidates[unique - 1] != candidates[i])
+            candidates[unique++] = candidates[i];
+    }
+    candidateCount = unique;
+
+    // Upper bound of the new cells per candidate row
+    long *bounds = (long *)malloc((candidateCount + 1) * sizeof(long));
+    long *births = (long *)malloc((candidateCount + 1) * sizeof(long));
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int c = 0; c < candidateCount; c++)
+    {
+        int y = candidates[c];
+        long lengths[3];
+        sparseRowCells(currentField, boundaryCoordinate(y - 1, height, boundary), &lengths[0]);
+        sparseRowCells(currentField, y, &lengths[1]);
+        sparseRowCells(currentField, boundaryCoordinate(y + 1, height, boundary), &lengths[2]);
+        bounds[c] = MIN(width, 3 * (lengths[0] + lengths[1] + lengths[2]));
+    }
+
+    long totalBound = 0;
+    for (int c = 0; c < candidateCount; c++)
+    {
+        long bound = bounds[c];
+        bounds[c] = totalBound;
+        totalBound += bound;
+    }
+    bounds[candidateCount] = totalBound;
+
+    int *scratch = (int *)malloc(MAX(totalBound, 1) * sizeof(int));
+
+    // Neighbor count accumulation, every candidate row is independent
+    #pragma omp parallel
+    {
+        // One byte per column, only the touched columns are reset after every row
+        unsigned char *columns = (unsigned char *)calloc(width, sizeof(unsigned char));
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int c = 0; c < candidateCount; c++)
+        {
+            int y = candidates[c];
+            long lengths[3];
+            int *cells[3] = {
+                sparseRowCells(currentField, boundaryCoordinate(y - 1, height, boundary), &lengths[0]),
+                sparseRowCells(currentField, y, &lengths[1]),
+                sparseRowCells(currentField, boundaryCoordinate(y + 1, height, boundary), &lengths[2]),
+            };
+
+            for (int k = 0; k < 3; k++)
+            {
+                for (long i = 0; i < lengths[k]; i++)
+                    columns[cells[k][i]] += 1;
+            }
+            for (long i = 0; i < lengths[1]; i++)
+                columns[cells[1][i]] |= SPARSE_COLUMN_CENTER;
+
+            // Every column next to a live cell is a candidate
+            int *out = scratch + bounds[c];
+            long born = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                for (long i = 0; i < lengths[k]; i++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        int x = boundaryCoordinate(cells[k][i] + dx, width, boundary);
+                        if (x < 0 || (columns[x] & SPARSE_COLUMN_VISITED))
+                            continue;
+                        columns[x] |= SPARSE_COLUMN_VISITED;
+
+                        int left = boundaryCoordinate(x - 1, width, boundary);
+                        int right = boundaryCoordinate(x + 1, width, boundary);
+                        int alive = (columns[x] & SPARSE_COLUMN_CENTER) != 0;
+                        int n = (columns[x] & SPARSE_COLUMN_COUNT) - alive +
+                                (left < 0 ? 0 : columns[left] & SPARSE_COLUMN_COUNT) +
+                                (right < 0 ? 0 : columns[right] & SPARSE_COLUMN_COUNT);
+
+                        // Either 3 neighbors or 2 neighbors and alive
+                        if (n == 3 || (n == 2 && alive))
+                            out[born++] = x;
+                    }
+                }
+            }
+
+            // Reset the touched columns
+            for (int k = 0; k < 3; k++)
+            {
+                for (long i = 0; i < lengths[k]; i++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        int x = boundaryCoordinate(cells[k][i] + dx, width, boundary);
+                        if (x >= 0)
+                            columns[x] = 0;
+                    }
+                }
+            }
+
+            qsort(out, born, sizeof(int), compareInt);
+            births[c] = born;
+        }
+
+        free(columns);
+    }
+
+    // Compact the rows into the new field
+    int rowCount = 0;
+    long population = 0;
+    for (int c = 0; c < candidateCount; c++)
+    {
+        rowCount += births[c] > 0;
+        population += births[c];
+    }
+    reserveSparseField(newField, rowCount, population);
+
+    int r = 0;
+    long offset = 0;
+    for (int c = 0; c < candidateCount; c++)
+    {
+        if (births[c] == 0)
+            continue;
+
+        newField->rows[r] = candidates[c];
+        newField->rowOffsets[r] = offset;
+        // Reuse bounds as source offset of the compacted row
+        bounds[r] = bounds[c];
+        offset += births[c];
+        r++;
+    }
+    newField->rowOffsets[rowCount] = population;
+    newField->rowCount = rowCount;
+    newField->population = population;
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < rowCount; i++)
+    {
+        memcpy(newField->xs + newField->rowOffsets[i], scratch + bounds[i],
+               (newField->rowOffsets[i + 1] - newField->rowOffsets[i]) * sizeof(int));
+    }
+
+    free(scratch);
+    free(births);
+    free(bounds);
+    free(candidates);
+}
+
+//
+// Automatic Dense <-> Sparse Switching
+//
+
+// Runs timesteps generations and switches between denseFunction and the sparse engine based on the population
+// density. Returns the field that holds the final generation (currentField or newField).
+static inline struct Field *simulateStepsAdaptive(int timesteps, struct Field *currentField, struct Field *newField,
+                                                  simulate_func denseFunction, double enterDensity, double leaveDensity)
+{
+    double area = (double)currentField->width * currentField->height;
+
+    struct SparseField sparseFields[2];
+    initializeSparseField(&sparseFields[0], currentField->width, currentField->height, currentField->boundary);
+    initializeSparseField(&sparseFields[1], currentField->width, currentField->height, currentField->boundary);
+    struct SparseField *currentSparse = &sparseFields[0];
+    struct SparseField *newSparse = &sparseFields[1];
+
+    bool sparse = false;
+    for (int t = 0; t < timesteps; t++)
+    {
+        if (!sparse && t % SPARSE_CHECK_INTERVAL == 0 && countPopulation(currentField) < enterDensity * area)
+        {
+            sparseFromField(currentSparse, currentField);
+            sparse = true;
+        }
+
+        if (sparse)
+        {
+            simulateStepSparse(currentSparse, newSparse);
+
+            struct SparseField *temp = currentSparse;
+            currentSparse = newSparse;
+            newSparse = temp;
+
+            if (currentSparse->population > leaveDensity * area)
+            {
+                sparseToField(currentSparse, currentField);
+                sparse = false;
+            }
+        }
+        else
+        {
+            denseFunction(currentField, newField, t);
+
+            struct Field *temp = currentField;
+            currentField = newField;
+            newField = temp;
+        }
+    }
+
+    if (sparse)
+        sparseToField(currentSparse, currentField);
+
+    freeSparseField(&sparseFields[0]);
+    freeSparseField(&sparseFields[1]);
+
+    return currentField;
+}
+
+#endif // GOL_SPARSE
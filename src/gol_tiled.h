@@ -0,0 +1,265 @@
+#ifndef GOL_TILED
+#define GOL_TILED
+
+#include "gol_field.h"
+#include "gol_plain_utils.h"
+
+//
+// Tiled Field
+//
+// Alternative storage layout: the board is cut into TILE_SIZE x TILE_SIZE tiles, every tile is stored contiguously
+// with a ring of halo cells (TILE_STRIDE x TILE_STRIDE, padded to cache lines) and the tiles are ordered along a
+// Morton (Z-order) curve. A tile of both generations fits into L1, its neighbors in the row above and below are a
+// few KiB away instead of a full board row, and the static schedule over the curve hands every thread a compact
+// block of tiles, so far fewer pages (TLB entries) are touched than by row major segments of a wide board.
+//
+// Before a tile is computed, its halo is copied from the edges of the neighboring tiles (or the boundary mode at the
+// edge of the board). Tiles at the right / bottom edge may be partial, their cells beyond the board stay unused.
+// Conversion to and from the row major struct Field is used for initialization and I/O.
+//
+
+#define TILE_BITS 6
+#define TILE_SIZE (1 << TILE_BITS)
+#define TILE_MASK (TILE_SIZE - 1)
+#define TILE_STRIDE (TILE_SIZE + 2)                           // cells of a tile row including the two halo columns
+#define TILE_CELLS ((TILE_STRIDE * TILE_STRIDE + 63) & ~63) // cells of a tile including its halo
+
+struct TiledField
+{
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    enum BoundaryMode boundary;
+
+    int *tileOffsets; // position of tile (tx, ty) on the Morton curve at ty * tilesX + tx
+    int *tileOrder;   // ty * tilesX + tx of the tile at every position of the curve
+
+    FieldType *tiles;
+    struct FieldBuffer buffer; // memory of tiles, see gol_alloc.h
+};
+
+// Interleaves the bits of x (even) and y (odd)
+static inline uint64_t mortonKey(uint32_t x, uint32_t y)
+{
+    uint64_t key = 0;
+    for (int bit = 0; bit < 32; bit++)
+    {
+        key |= (uint64_t)(x >> bit & 1) << (2 * bit);
+        key |= (uint64_t)(y >> bit & 1) << (2 * bit + 1);
+    }
+    return key;
+}
+
+static int compareTileKeys(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static inline void initializeTiledField(struct TiledField *field, int width, int height, enum BoundaryMode boundary)
+{
+    field->width = width;
+    field->height = height;
+    field->tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    field->tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    field->boundary = boundary;
+
+    // Sorting the Morton keys skips the positions of the curve outside of boards that are not square powers of two
+    int tiles = field->tilesX * field->tilesY;
+    uint64_t *keys = (uint64_t *)malloc(tiles * sizeof(uint64_t));
+    for (int i = 0; i < tiles; i++)
+        keys[i] = mortonKey(i % field->tilesX, i / field->tilesX) << 32 | (uint64_t)i;
+    qsort(keys, tiles, sizeof(uint64_t), compareTileKeys);
+
+    field->tileOffsets = (int *)malloc(tiles * sizeof(int));
+    field->tileOrder = (int *)malloc(tiles * sizeof(int));
+    for (int position = 0; position < tiles; position++)
+    {
+        int tile = keys[position] & 0xffffffff;
+        field->tileOrder[position] = tile;
+        field->tileOffsets[tile] = position;
+    }
+    free(keys);
+
+    allocateFieldBuffer(&field->buffer, (size_t)tiles * TILE_CELLS * sizeof(FieldType));
+    field->tiles = (FieldType *)field->buffer.memory;
+}
+
+static inline void initializeTiledFieldOther(struct TiledField *field, struct TiledField *other)
+{
+    initializeTiledField(field, other->width, other->height, other->boundary);
+}
+
+static inline void freeTiledField(struct TiledField *field)
+{
+    releaseFieldBuffer(&field->buffer);
+    field->tiles = NULL;
+    free(field->tileOffsets);
+    free(field->tileOrder);
+}
+
+// First cell (halo included) of the tile at position of the curve
+static inline FieldType *tileAt(struct TiledField *field, int position)
+{
+    return field->tiles + (size_t)position * TILE_CELLS;
+}
+
+// Cell (x, y) of the board
+static inline FieldType *tiledCell(struct TiledField *field, int x, int y)
+{
+    int position = field->tileOffsets[(y >> TILE_BITS) * field->tilesX + (x >> TILE_BITS)];
+    return tileAt(field, position) + ((y & TILE_MASK) + 1) * TILE_STRIDE + (x & TILE_MASK) + 1;
+}
+
+//
+// Conversion
+//
+
+static inline void tiledFromField(struct TiledField *tiled, struct Field *field)
+{
+    #pragma omp parallel for schedule(static)
+    for (int position = 0; position < tiled->tilesX * tiled->tilesY; position++)
+    {
+        int tile = tiled->tileOrder[position];
+        int x0 = tile % tiled->tilesX * TILE_SIZE;
+        int y0 = tile / tiled->tilesX * TILE_SIZE;
+        int w = MIN(TILE_SIZE, tiled->width - x0);
+        int h = MIN(TILE_SIZE, tiled->height - y0);
+
+        FieldType *cells = tileAt(tiled, position);
+        for (int ly = 0; ly < h; ly++)
+            memcpy(cells + (ly + 1) * TILE_STRIDE + 1, field->field + calcIndex(field->width, x0, y0 + ly), w * sizeof(FieldType));
+    }
+}
+
+static inline void fieldFromTiled(struct Field *field, struct TiledField *tiled)
+{
+    #pragma omp parallel for schedule(static)
+    for (int position = 0; position < tiled->tilesX * tiled->tilesY; position++)
+    {
+        int tile = tiled->tileOrder[position];
+        int x0 = tile % tiled->tilesX * TILE_SIZE;
+        int y0 = tile / tiled->tilesX * TILE_SIZE;
+        int w = MIN(TILE_SIZE, tiled->width - x0);
+        int h = MIN(TILE_SIZE, tiled->height - y0);
+
+        FieldType *cells = tileAt(tiled, position);
+        for (int ly = 0; ly < h; ly++)
+            memcpy(field->field + calcIndex(field->width, x0, y0 + ly), cells + (ly + 1) * TILE_STRIDE + 1, w * sizeof(FieldType));
+    }
+}
+
+//
+// Simulation
+//
+
+// Copies the edges of the neighboring tiles (or the boundary) into the halo of the tile at position
+static inline void fillTileHalo(struct TiledField *field, int position)
+{
+    int tile = field->tileOrder[position];
+    int x0 = tile % field->tilesX * TILE_SIZE;
+    int y0 = tile / field->tilesX * TILE_SIZE;
+    int w = MIN(TILE_SIZE, field->width - x0);
+    int h = MIN(TILE_SIZE, field->height - y0);
+    FieldType *cells = tileAt(field, position);
+
+    // Rows above and below: w cells of a single neighbor tile
+    for (int side = 0; side < 2; side++)
+    {
+        int by = boundaryCoordinate(side == 0 ? y0 - 1 : y0 + h, field->height, field->boundary);
+        FieldType *halo = cells + (side == 0 ? 0 : h + 1) * TILE_STRIDE + 1;
+        if (by < 0)
+            memset(halo, 0, w * sizeof(FieldType));
+        else
+            memcpy(halo, tiledCell(field, x0, by), w * sizeof(FieldType));
+    }
+
+    // Columns left and right: h cells of a single neighbor tile, the corners come from the diagonal neighbors
+    for (int side = 0; side < 2; side++)
+    {
+        int bx = boundaryCoordinate(side == 0 ? x0 - 1 : x0 + w, field->width, field->boundary);
+        FieldType *halo = cells + (side == 0 ? 0 : w + 1);
+        if (bx < 0)
+        {
+            for (int ly = 0; ly < h + 2; ly++)
+                halo[ly * TILE_STRIDE] = 0;
+            continue;
+        }
+
+        const FieldType *column = tiledCell(field, bx, y0);
+        for (int ly = 1; ly <= h; ly++)
+            halo[ly * TILE_STRIDE] = column[(ly - 1) * TILE_STRIDE];
+
+        for (int ly = 0; ly < h + 2; ly += h + 1)
+        {
+            int by = boundaryCoordinate(y0 + ly - 1, field->height, field->boundary);
+            halo[ly * TILE_STRIDE] = by >= 0 ? *tiledCell(field, bx, by) : 0;
+        }
+    }
+}
+
+// Rows 1 to h of a tile, cells 1 to w of every row
+static inline void golKernelTileRows(const FieldType *cells, FieldType *newCells, int w, int h)
+{
+    for (int ly = 1; ly <= h; ly++)
+    {
+        const FieldType *above = cells + (ly - 1) * TILE_STRIDE;
+        const FieldType *row = above + TILE_STRIDE;
+        const FieldType *below = row + TILE_STRIDE;
+        FieldType *out = newCells + ly * TILE_STRIDE;
+
+        for (int lx = 1; lx <= w; lx++)
+        {
+            FieldType n = above[lx - 1] + above[lx] + above[lx + 1] +
+                    row[lx - 1] + row[lx + 1] +
+                    below[lx - 1] + below[lx] + below[lx + 1];
+
+            out[lx] = (n == 3) | ((n == 2) & row[lx]);
+        }
+    }
+}
+
+static inline void golKernelTile(struct TiledField *currentField, struct TiledField *newField, int position)
+{
+    int tile = currentField->tileOrder[position];
+    int w = MIN(TILE_SIZE, currentField->width - tile % currentField->tilesX * TILE_SIZE);
+    int h = MIN(TILE_SIZE, currentField->height - tile / currentField->tilesX * TILE_SIZE);
+
+    // Full tiles with constant bounds, the row loop is vectorized without remainder
+    if (w == TILE_SIZE && h == TILE_SIZE)
+        golKernelTileRows(tileAt(currentField, position), tileAt(newField, position), TILE_SIZE, TILE_SIZE);
+    else
+        golKernelTileRows(tileAt(currentField, position), tileAt(newField, position), w, h);
+}
+
+// One generation, the halos of currentField are refreshed on the way (every tile only writes its own halo)
+static inline void simulateStepTiled(struct TiledField *currentField, struct TiledField *newField)
+{
+    // Static schedule: consecutive positions on the curve form compact blocks of tiles per thread
+    #pragma omp parallel for schedule(static)
+    for (int position = 0; position < currentField->tilesX * currentField->tilesY; position++)
+    {
+        fillTileHalo(currentField, position);
+        golKernelTile(currentField, newField, position);
+    }
+}
+
+// Runs timesteps generations of field in the tiled layout, the result is written back to field
+static inline void simulateStepsTiled(int timesteps, struct Field *field)
+{
+    struct TiledField tiled[2];
+    initializeTiledField(&tiled[0], field->width, field->height, field->boundary);
+    initializeTiledFieldOther(&tiled[1], &tiled[0]);
+    tiledFromField(&tiled[0], field);
+
+    for (int t = 0; t < timesteps; t++)
+        simulateStepTiled(&tiled[t & 1], &tiled[(t + 1) & 1]);
+
+    fieldFromTiled(field, &tiled[timesteps & 1]);
+    freeTiledField(&tiled[0]);
+    freeTiledField(&tiled[1]);
+}
+
+#endif // GOL_TILED
@@ -0,0 +1,241 @@
+#ifndef GOL_TRACE
+#define GOL_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <omp.h>
+
+#include "gol_field.h"
+
+//
+// Timeline Tracing
+//
+// Records when every thread works on which segment of the OMP engine and how long it waits at the barrier at the end
+// of a step. Compiled in with -D USE_TRACE (make build-gol-trace), otherwise the TRACE_* macros are empty and cost
+// nothing. Every thread appends to its own preallocated ring buffer (no locks, no allocation while tracing), the
+// oldest events are overwritten once a buffer is full.
+//
+// The events are exported as Chrome trace JSON (chrome://tracing, https://ui.perfetto.dev), and the per step
+// imbalance is summarized: max / mean segment time and the barrier wait of the threads.
+//
+
+#define TRACE_DEFAULT_CAPACITY (1 << 16) // events per thread
+
+enum TraceKind
+{
+    TRACE_STEP,    // whole step on the master thread
+    TRACE_SEGMENT, // interior of one (i, j) segment
+    TRACE_BORDER,  // the border cells of one thread
+    TRACE_BARRIER, // waiting for the other threads at the end of the step
+};
+
+struct TraceEvent
+{
+    double begin; // seconds since initializeTracer
+    double end;
+    int step;
+    int segment; // i * segmentsY + j for TRACE_SEGMENT, otherwise -1
+    enum TraceKind kind;
+};
+
+// One ring per thread, aligned to separate cache lines
+struct TraceRing
+{
+    struct TraceEvent *events;
+    long count; // events recorded, the ring holds the last MIN(count, capacity)
+    char padding[64 - sizeof(struct TraceEvent *) - sizeof(long)];
+};
+
+struct Tracer
+{
+    double origin;
+    int threads;
+    long capacity;
+    struct TraceRing *rings; // NULL if tracing is not active
+
+    int segmentsY; // to name the segments (i, j) in the export
+};
+
+static struct Tracer tracer = {0};
+
+static inline void initializeTracer(int threads, long capacity, int segmentsY)
+{
+    tracer.origin = omp_get_wtime();
+    tracer.threads = threads;
+    tracer.capacity = capacity;
+    tracer.segmentsY = segmentsY;
+    tracer.rings = (struct TraceRing *)calloc(threads, sizeof(struct TraceRing));
+    for (int t = 0; t < threads; t++)
+    {
+        tracer.rings[t].events = (struct TraceEvent *)malloc(capacity * sizeof(struct TraceEvent));
+    }
+}
+
+static inline void freeTracer(void)
+{
+    if (tracer.rings == NULL)
+        return;
+
+    for (int t = 0; t < tracer.threads; t++)
+    {
+        free(tracer.rings[t].events);
+    }
+    free(tracer.rings);
+    tracer.rings = NULL;
+}
+
+static inline void traceRecord(enum TraceKind kind, int step, int segment, double begin, double end)
+{
+    int thread = omp_get_thread_num();
+    if (tracer.rings == NULL || thread >= tracer.threads)
+        return;
+
+    struct TraceRing *ring = &tracer.rings[thread];
+    struct TraceEvent *event = &ring->events[ring->count++ % tracer.capacity];
+    event->begin = begin - tracer.origin;
+    event->end = end - tracer.origin;
+    event->step = step;
+    event->segment = segment;
+    event->kind = kind;
+}
+
+#ifdef USE_TRACE
+
+// Starts a time measurement named NAME
+#define TRACE_BEGIN(NAME) double NAME = omp_get_wtime();
+
+// Records an event from the measurement NAME until now
+#define TRACE_END(NAME, KIND, STEP, SEGMENT) traceRecord(KIND, STEP, SEGMENT, NAME, omp_get_wtime());
+
+// Explicit barrier at the end of the work of a step, records how long the thread waited for the others
+#define TRACE_BARRIER_WAIT(STEP)                                                \
+    {                                                                           \
+        double traceWait = omp_get_wtime();                                     \
+        _Pragma("omp barrier")                                                  \
+        traceRecord(TRACE_BARRIER, STEP, -1, traceWait, omp_get_wtime());       \
+    }
+
+#else // USE_TRACE
+
+#define TRACE_BEGIN(NAME)
+#define TRACE_END(NAME, KIND, STEP, SEGMENT)
+#define TRACE_BARRIER_WAIT(STEP)
+
+#endif // USE_TRACE
+
+static const char *traceKindNames[] = {"step", "segment", "border", "barrier"};
+
+// Chrome trace event format: one complete event ("ph": "X") per recorded event, timestamps in microseconds
+static inline void writeTraceJSON(FILE *file)
+{
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    for (int t = 0; t < tracer.threads; t++)
+    {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"OMP thread %d\"}}",
+                first ? "" : ",\n", t, t);
+        first = false;
+
+        struct TraceRing *ring = &tracer.rings[t];
+        long start = ring->count > tracer.capacity ? ring->count - tracer.capacity : 0;
+        for (long e = start; e < ring->count; e++)
+        {
+            struct TraceEvent *event = &ring->events[e % tracer.capacity];
+            char name[64];
+            if (event->kind == TRACE_SEGMENT)
+                snprintf(name, sizeof(name), "segment (%d, %d)", event->segment / tracer.segmentsY, event->segment % tracer.segmentsY);
+            else
+                snprintf(name, sizeof(name), "%s", traceKindNames[event->kind]);
+
+            fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                          "\"args\": {\"step\": %d}}",
+                    name, traceKindNames[event->kind], t, event->begin * 1e6, (event->end - event->begin) * 1e6, event->step);
+        }
+    }
+    fprintf(file, "\n]}\n");
+}
+
+// Per step: step time, max / mean segment time and max / mean barrier wait of the threads, plus the mean over all
+// steps. Steps are identified by the step number of the events, only steps still in the rings are included.
+static inline void printTraceSummary(FILE *file)
+{
+    int minStep = 0;
+    int maxStep = -1;
+    for (int t = 0; t < tracer.threads; t++)
+    {
+        struct TraceRing *ring = &tracer.rings[t];
+        long start = ring->count > tracer.capacity ? ring->count - tracer.capacity : 0;
+        for (long e = start; e < ring->count; e++)
+        {
+            int step = ring->events[e % tracer.capacity].step;
+            if (maxStep < minStep)
+                minStep = maxStep = step;
+            minStep = MIN(minStep, step);
+            maxStep = MAX(maxStep, step);
+        }
+    }
+    if (maxStep < minStep)
+        return;
+
+    // step, segment max, segment sum, segment count, wait max, wait sum, wait count
+    int steps = maxStep - minStep + 1;
+    double *values = (double *)calloc((size_t)steps * 7, sizeof(double));
+    for (int t = 0; t < tracer.threads; t++)
+    {
+        struct TraceRing *ring = &tracer.rings[t];
+        long start = ring->count > tracer.capacity ? ring->count - tracer.capacity : 0;
+        for (long e = start; e < ring->count; e++)
+        {
+            struct TraceEvent *event = &ring->events[e % tracer.capacity];
+            double *step = values + (size_t)(event->step - minStep) * 7;
+            double duration = event->end - event->begin;
+            switch (event->kind)
+            {
+            case TRACE_STEP:
+                step[0] = duration;
+                break;
+            case TRACE_SEGMENT:
+                step[1] = MAX(step[1], duration);
+                step[2] += duration;
+                step[3]++;
+                break;
+            case TRACE_BARRIER:
+                step[4] = MAX(step[4], duration);
+                step[5] += duration;
+                step[6]++;
+                break;
+            case TRACE_BORDER:
+                break;
+            }
+        }
+    }
+
+    fprintf(file, "step,step_time,segment_max,segment_mean,segment_imbalance,barrier_max,barrier_mean\n");
+    double total[6] = {0};
+    int counted = 0;
+    for (int s = 0; s < steps; s++)
+    {
+        double *step = values + (size_t)s * 7;
+        if (step[3] == 0)
+            continue;
+
+        double segmentMean = step[2] / step[3];
+        double waitMean = step[6] > 0 ? step[5] / step[6] : 0;
+        double row[6] = {step[0], step[1], segmentMean, step[1] / segmentMean, step[4], waitMean};
+        fprintf(file, "%d,%e,%e,%e,%f,%e,%e\n", minStep + s, row[0], row[1], row[2], row[3], row[4], row[5]);
+
+        for (int k = 0; k < 6; k++)
+            total[k] += row[k];
+        counted++;
+    }
+    if (counted > 0)
+    {
+        fprintf(file, "mean,%e,%e,%e,%f,%e,%e\n", total[0] / counted, total[1] / counted, total[2] / counted,
+                total[3] / counted, total[4] / counted, total[5] / counted);
+    }
+
+    free(values);
+}
+
+#endif // GOL_TRACE
@@ -6,19 +6,23 @@
 
 static inline void simulateStepVanillaPlain(struct Field *currentField, struct Field *newField, int timestep)
 {
-    VTK_INIT
+    struct FieldStatistics statistics;
+    initializeFieldStatistics(&statistics);
+    struct FieldStatistics *tracked = currentField->tracking ? &statistics : NULL;
 
-    int x, y;
-    for (y = 0; y < currentField->height; y++)
+    golKernelInteriorRegion(currentField, newField, 0, currentField->width, 0, currentField->height, tracked);
+
+    // Separate border pass, the interior never checks boundaries
+    int borderCells = borderCellCount(currentField);
+    for (int i = 0; i < borderCells; i++)
     {
-        for (x = 0; x < currentField->width; x++)
-        {
-            golKernel(currentField, newField, x, y);
-            VTK_OUTPUT_SEGMENT(timestep, 0, currentField->width, 0, currentField->height)
-        }
+        golKernelBorderCell(currentField, newField, i, tracked);
     }
 
-    VTK_OUTPUT_MASTER(timestep)
+    if (currentField->tracking & TRACK_DENSITY)
+        completeDensitySegment(newField, 0, currentField->width, 0, currentField->height);
+
+    newField->statistics = statistics;
 }
 
 #endif // GOL_VANILLA
@@ -0,0 +1,221 @@
+// Implementation of the C API in libgol.h, built as build/libgol.so.
+// Only the functions marked with GOL_EXPORT are visible, the helpers of the included headers stay internal.
+
+#include "libgol.h"
+
+#include "gol_field.h"
+#include "gol_vanilla.h"
+#include "gol_omp.h"
+#include "gol_sparse.h"
+#include "gol_lightcone.h"
+
+#define GOL_EXPORT __attribute__((visibility("default")))
+
+struct GolBoard
+{
+    struct Field fields[2];
+    struct Field *currentField;
+    struct Field *newField;
+
+    int64_t generation;
+    bool statisticsValid; // currentField->statistics belongs to the current generation
+};
+
+GOL_EXPORT int golApiVersion(void)
+{
+    return GOL_API_VERSION;
+}
+
+GOL_EXPORT GolBoard *golCreate(int width, int height, int boundary)
+{
+    if (width <= 0 || height <= 0 || boundary < GOL_BOUNDARY_TORUS || boundary > GOL_BOUNDARY_REFLECT)
+        return NULL;
+
+    GolBoard *board = (GolBoard *)calloc(1, sizeof(GolBoard));
+    if (board == NULL)
+        return NULL;
+
+    initializeFields(&board->fields[0], &board->fields[1], width, height, 0, 0);
+    setBoundaryMode(&board->fields[0], &board->fields[1], (enum BoundaryMode)boundary);
+    board->currentField = &board->fields[0];
+    board->newField = &board->fields[1];
+    return board;
+}
+
+GOL_EXPORT void golDestroy(GolBoard *board)
+{
+    if (board == NULL)
+        return;
+
+    freeField(&board->fields[0]);
+    freeField(&board->fields[1]);
+    free(board);
+}
+
+GOL_EXPORT void golReleaseMemory(void)
+{
+    clearFieldPool();
+}
+
+GOL_EXPORT int golWidth(const GolBoard *board)
+{
+    if (board == NULL)
+        return 0;
+
+    return board->currentField->width;
+}
+
+GOL_EXPORT int golHeight(const GolBoard *board)
+{
+    if (board == NULL)
+        return 0;
+
+    return board->currentField->height;
+}
+
+GOL_EXPORT int64_t golGeneration(const GolBoard *board)
+{
+    if (board == NULL)
+        return -1;
+
+    return board->generation;
+}
+
+GOL_EXPORT uint8_t *golCells(GolBoard *board)
+{
+    if (board == NULL)
+        return NULL;
+
+    return (uint8_t *)board->currentField->field;
+}
+
+GOL_EXPORT int golLoad(GolBoard *board, const uint8_t *cells)
+{
+    if (board == NULL || cells == NULL)
+        return GOL_ERROR_ARGUMENT;
+
+    struct Field *field = board->currentField;
+    long count = (long)field->width * field->height;
+    for (long i = 0; i < count; i++)
+    {
+        field->field[i] = cells[i] != 0;
+    }
+
+    board->generation = 0;
+    board->statisticsValid = false;
+    return GOL_OK;
+}
+
+GOL_EXPORT int golFillRandom(GolBoard *board, double density, unsigned int seed)
+{
+    if (board == NULL || density < 0 || density > 1)
+        return GOL_ERROR_ARGUMENT;
+
+    srand(seed);
+    fillRandomDensity(board->currentField, density);
+
+    board->generation = 0;
+    board->statisticsValid = false;
+    return GOL_OK;
+}
+
+GOL_EXPORT int golSetThreads(int threads)
+{
+    if (threads < 0)
+        return GOL_ERROR_ARGUMENT;
+
+    omp_set_dynamic(0);
+    omp_set_num_threads(threads > 0 ? threads : omp_get_num_procs());
+    return GOL_OK;
+}
+
+GOL_EXPORT int golTrackStatistics(GolBoard *board, int enabled)
+{
+    if (board == NULL)
+        return GOL_ERROR_ARGUMENT;
+
+    unsigned int tracking = enabled ? TRACK_STATISTICS : 0;
+    board->fields[0].tracking = tracking;
+    board->fields[1].tracking = tracking;
+    return GOL_OK;
+}
+
+GOL_EXPORT int golStep(GolBoard *board, int generations, int engine)
+{
+    if (board == NULL || generations < 0)
+        return GOL_ERROR_ARGUMENT;
+
+    simulate_func simulateFunction = engine == GOL_ENGINE_VANILLA ? &simulateStepVanillaPlain : &simulateStepOMPPlain;
+    switch (engine)
+    {
+    case GOL_ENGINE_VANILLA:
+    case GOL_ENGINE_OMP:
+        for (int t = 0; t < generations; t++)
+        {
+            simulateFunction(board->currentField, board->newField, board->generation + t);
+
+            struct Field *temp = board->currentField;
+            board->currentField = board->newField;
+            board->newField = temp;
+        }
+        board->statisticsValid = board->currentField->tracking != 0 && generations > 0;
+        break;
+    case GOL_ENGINE_SPARSE:
+    case GOL_ENGINE_AUTO:
+    {
+        double enter = engine == GOL_ENGINE_SPARSE ? INFINITY : SPARSE_DENSITY_ENTER;
+        double leave = engine == GOL_ENGINE_SPARSE ? INFINITY : SPARSE_DENSITY_LEAVE;
+        struct Field *finalField = simulateStepsAdaptive(generations, board->currentField, board->newField, simulateFunction, enter, leave);
+        if (finalField != board->currentField)
+        {
+            board->newField = board->currentField;
+            board->currentField = finalField;
+        }
+        board->statisticsValid = false;
+        break;
+    }
+    default:
+        return GOL_ERROR_ARGUMENT;
+    }
+
+    board->generation += generations;
+    return GOL_OK;
+}
+
+GOL_EXPORT int golStatistics(GolBoard *board, struct GolStatistics *statistics)
+{
+    if (board == NULL || statistics == NULL)
+        return GOL_ERROR_ARGUMENT;
+
+    struct FieldStatistics current;
+    if (board->statisticsValid)
+    {
+        current = board->currentField->statistics;
+    }
+    else
+    {
+        // Separate pass, births and deaths are unknown
+        computeFieldStatistics(board->currentField, &current);
+        current.births = -1;
+        current.deaths = -1;
+    }
+
+    statistics->generation = board->generation;
+    statistics->population = current.population;
+    statistics->births = current.births;
+    statistics->deaths = current.deaths;
+    statistics->minX = current.minX;
+    statistics->minY = current.minY;
+    statistics->maxX = current.maxX;
+    statistics->maxY = current.maxY;
+    return GOL_OK;
+}
+
+GOL_EXPORT int golViewport(GolBoard *board, int x, int y, int width, int height, int generations, uint8_t *cells)
+{
+    if (board == NULL || cells == NULL || width <= 0 || height <= 0 || generations < 0)
+        return GOL_ERROR_ARGUMENT;
+
+    computeViewport(board->currentField, x, y, width, height, generations, (FieldType *)cells);
+    return GOL_OK;
+}
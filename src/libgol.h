@@ -0,0 +1,109 @@
+#ifndef LIBGOL
+#define LIBGOL
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// libgol: C API of the simulator (build/libgol.so)
+//
+// A board owns two generations of width * height cells (one byte per cell, 0 dead / 1 alive, row major). The cells
+// of the current generation are accessed in place through golCells, e.g. wrapped as NumPy array without a copy.
+// All functions return GOL_OK or a negative GOL_ERROR_* code unless noted otherwise. Boards must not be created,
+// destroyed or stepped from several threads at once; every step itself runs on the OpenMP threads.
+//
+// The API is versioned with GOL_API_VERSION, values of the enums and the layout of GolStatistics do not change
+// within a version.
+//
+
+#define GOL_API_VERSION 1
+
+#define GOL_OK 0
+#define GOL_ERROR_ARGUMENT -1 // invalid argument or unknown engine
+
+typedef struct GolBoard GolBoard;
+
+enum GolEngine
+{
+    GOL_ENGINE_VANILLA = 0, // single threaded
+    GOL_ENGINE_OMP = 1,     // OpenMP
+    GOL_ENGINE_SPARSE = 2,  // live cell lists, for mostly empty boards
+    GOL_ENGINE_AUTO = 3,    // switches between OMP and sparse depending on the density
+};
+
+enum GolBoundary
+{
+    GOL_BOUNDARY_TORUS = 0,
+    GOL_BOUNDARY_DEAD = 1,
+    GOL_BOUNDARY_REFLECT = 2,
+};
+
+struct GolStatistics
+{
+    int64_t generation;
+    int64_t population;
+    int64_t births; // since the previous generation, -1 if unknown (see golTrackStatistics)
+    int64_t deaths;
+
+    // Bounding box of the live cells (inclusive), min > max if there are none
+    int32_t minX;
+    int32_t minY;
+    int32_t maxX;
+    int32_t maxY;
+};
+
+int golApiVersion(void);
+
+// Board with all cells dead, NULL on invalid arguments. Like the simulator, the process exits if no memory is left.
+GolBoard *golCreate(int width, int height, int boundary);
+
+// Releases the board, NULL is ignored. The buffers of its generations stay in a pool of the library (at most 8) and
+// are reused by the next boards of the same size, see golReleaseMemory.
+void golDestroy(GolBoard *board);
+
+// Returns the pooled buffers of destroyed boards to the system, e.g. after a sweep over many boards
+void golReleaseMemory(void);
+
+// Size of the board, 0 for NULL
+int golWidth(const GolBoard *board);
+int golHeight(const GolBoard *board);
+
+// Generation of the current cells, -1 for NULL
+int64_t golGeneration(const GolBoard *board);
+
+// Cells of the current generation, valid until the next golStep / golDestroy (the generations swap buffers). NULL for
+// NULL.
+uint8_t *golCells(GolBoard *board);
+
+// Copies width * height cells (non zero is alive) into the current generation and resets the generation counter
+int golLoad(GolBoard *board, const uint8_t *cells);
+
+// Random cells with the given density, reproducible for a seed. Resets the generation counter.
+int golFillRandom(GolBoard *board, double density, unsigned int seed);
+
+// Number of OpenMP threads of the following steps, 0 uses all processors. Boards created afterwards are segmented
+// for this number of threads.
+int golSetThreads(int threads);
+
+// Computes births and deaths during the following steps of the vanilla and omp engines (slightly slower)
+int golTrackStatistics(GolBoard *board, int enabled);
+
+// Advances the board by generations with the engine
+int golStep(GolBoard *board, int generations, int engine);
+
+// Statistics of the current generation
+int golStatistics(GolBoard *board, struct GolStatistics *statistics);
+
+// Writes the width x height window at (x, y) of the generation generations ahead into cells (row major) without
+// advancing the board. Only the backward light cone of the window is simulated. The window may reach over the edges,
+// the cells there follow the boundary of the board.
+int golViewport(GolBoard *board, int x, int y, int width, int height, int generations, uint8_t *cells);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBGOL
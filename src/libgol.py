@@ -0,0 +1,160 @@
+"""ctypes wrapper of build/libgol.so (see src/libgol.h), boards stay resident between step calls.
+
+>>> board = Board(1024, 1024)
+>>> board.fill_random(0.3, seed=1)
+>>> board.step(100, ENGINE_OMP)
+>>> board.cells.sum()  # NumPy view of the current generation, no copy
+"""
+import ctypes
+from pathlib import Path
+
+import numpy as np
+
+PATH_LIBRARY = Path(__file__).parent.parent.joinpath("build", "libgol.so")
+
+API_VERSION = 1
+
+ENGINE_VANILLA = 0
+ENGINE_OMP = 1
+ENGINE_SPARSE = 2
+ENGINE_AUTO = 3
+
+BOUNDARY_TORUS = 0
+BOUNDARY_DEAD = 1
+BOUNDARY_REFLECT = 2
+
+
+class Statistics(ctypes.Structure):
+    _fields_ = [
+        ("generation", ctypes.c_int64),
+        ("population", ctypes.c_int64),
+        ("births", ctypes.c_int64),  # -1 if unknown
+        ("deaths", ctypes.c_int64),
+        ("min_x", ctypes.c_int32),
+        ("min_y", ctypes.c_int32),
+        ("max_x", ctypes.c_int32),
+        ("max_y", ctypes.c_int32),
+    ]
+
+
+def _load_library(path: Path) -> ctypes.CDLL:
+    library = ctypes.CDLL(str(path))
+
+    board = ctypes.c_void_p
+    signatures = {
+        "golApiVersion": (ctypes.c_int, []),
+        "golCreate": (board, [ctypes.c_int, ctypes.c_int, ctypes.c_int]),
+        "golDestroy": (None, [board]),
+        "golReleaseMemory": (None, []),
+        "golWidth": (ctypes.c_int, [board]),
+        "golHeight": (ctypes.c_int, [board]),
+        "golGeneration": (ctypes.c_int64, [board]),
+        "golCells": (ctypes.POINTER(ctypes.c_uint8), [board]),
+        "golLoad": (ctypes.c_int, [board, ctypes.POINTER(ctypes.c_uint8)]),
+        "golFillRandom": (ctypes.c_int, [board, ctypes.c_double, ctypes.c_uint]),
+        "golSetThreads": (ctypes.c_int, [ctypes.c_int]),
+        "golTrackStatistics": (ctypes.c_int, [board, ctypes.c_int]),
+        "golStep": (ctypes.c_int, [board, ctypes.c_int, ctypes.c_int]),
+        "golStatistics": (ctypes.c_int, [board, ctypes.POINTER(Statistics)]),
+        "golViewport": (ctypes.c_int, [board] + [ctypes.c_int] * 5 + [ctypes.POINTER(ctypes.c_uint8)]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(library, name)
+        function.restype = restype
+        function.argtypes = argtypes
+
+    version = library.golApiVersion()
+    if version != API_VERSION:
+        raise RuntimeError(f"{path} has API version {version}, expected {API_VERSION}")
+    return library
+
+
+_library = None
+
+
+def library() -> ctypes.CDLL:
+    global _library
+    if _library is None:
+        _library = _load_library(PATH_LIBRARY)
+    return _library
+
+
+def _check(result: int, name: str):
+    if result < 0:
+        raise ValueError(f"{name} failed with error {result}")
+
+
+def set_threads(threads: int):
+    """Number of OpenMP threads of the following steps, 0 uses all processors"""
+    _check(library().golSetThreads(threads), "golSetThreads")
+
+
+def release_memory():
+    """Returns the memory of closed boards, which the library keeps for the next boards of the same size"""
+    library().golReleaseMemory()
+
+
+class Board:
+    def __init__(self, width: int, height: int, boundary: int = BOUNDARY_TORUS):
+        self._library = library()
+        self._board = self._library.golCreate(width, height, boundary)
+        if not self._board:
+            raise ValueError(f"Could not create a {width}x{height} board with boundary {boundary}")
+        self.width = width
+        self.height = height
+
+    def close(self):
+        if self._board:
+            self._library.golDestroy(self._board)
+            self._board = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exception):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    @property
+    def generation(self) -> int:
+        return self._library.golGeneration(self._board)
+
+    @property
+    def cells(self) -> np.ndarray:
+        """height x width uint8 view of the current generation.
+
+        The view shares the memory of the board and is only valid until the next step (the generations swap
+        buffers), so read it again after every step and copy it to keep a generation.
+        """
+        pointer = self._library.golCells(self._board)
+        return np.ctypeslib.as_array(pointer, shape=(self.height, self.width))
+
+    def load(self, cells: np.ndarray):
+        cells = np.ascontiguousarray(cells, dtype=np.uint8)
+        if cells.shape != (self.height, self.width):
+            raise ValueError(f"Expected cells of shape {(self.height, self.width)}, got {cells.shape}")
+        _check(self._library.golLoad(self._board, cells.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8))), "golLoad")
+
+    def fill_random(self, density: float, seed: int = 0):
+        _check(self._library.golFillRandom(self._board, density, seed), "golFillRandom")
+
+    def track_statistics(self, enabled: bool = True):
+        """Births and deaths of the vanilla and omp engines, computed during the steps"""
+        _check(self._library.golTrackStatistics(self._board, int(enabled)), "golTrackStatistics")
+
+    def step(self, generations: int = 1, engine: int = ENGINE_OMP):
+        _check(self._library.golStep(self._board, generations, engine), "golStep")
+
+    def viewport(self, x: int, y: int, width: int, height: int, generations: int) -> np.ndarray:
+        """height x width window at (x, y) generations ahead, computed from its light cone, the board is not advanced"""
+        cells = np.empty((height, width), dtype=np.uint8)
+        pointer = cells.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8))
+        _check(self._library.golViewport(self._board, x, y, width, height, generations, pointer), "golViewport")
+        return cells
+
+    def statistics(self) -> Statistics:
+        statistics = Statistics()
+        _check(self._library.golStatistics(self._board, ctypes.byref(statistics)), "golStatistics")
+        return statistics